@@ -3,6 +3,29 @@
 #include <assert.h>
 #include <cmath>
 #include <vector>
+#include <cstring>
+#include <cstdint>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <atomic>
+#include <unordered_map>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
@@ -27,16 +50,614 @@ using namespace glm;
 // ================================
 
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+
+// ================================
+// Profiler de CPU (zonas com escopo, exportação para Chrome trace)
+// ================================
+// Compilado só com PERFIL_CPU definido (opção PERFIL_CPU do CMake); sem ele, PERFIL_ZONA não gera
+// código nenhum. Cada thread grava seus eventos em um anel próprio, sem travas: só ela escreve e
+// o contador de escrita é publicado com release. A exportação (F2, ou sozinha quando um quadro
+// demora mais que LIMIAR_TRAVAMENTO_S) gera um JSON que abre em chrome://tracing ou no Perfetto.
+
+const double LIMIAR_TRAVAMENTO_S = 0.050;
+
+#ifdef PERFIL_CPU
+
+struct EventoPerfil
+{
+    const char *nome; // sempre um literal
+    uint64_t inicioNs;
+    uint64_t duracaoNs;
+};
+
+const uint64_t CAPACIDADE_PERFIL = 1 << 15; // eventos por thread
+
+struct BufferPerfil
+{
+    vector<EventoPerfil> eventos = vector<EventoPerfil>(CAPACIDADE_PERFIL);
+    atomic<uint64_t> escritos{0};
+    int idThread = 0;
+};
+
+mutex travaBuffersPerfil;
+vector<BufferPerfil *> buffersPerfil; // nunca liberados: a exportação pode ler depois que a thread termina
+
+inline uint64_t relogioPerfilNs()
+{
+    static const auto origem = chrono::steady_clock::now();
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origem).count();
+}
+
+BufferPerfil *registrarBufferPerfil()
+{
+    BufferPerfil *buffer = new BufferPerfil();
+    lock_guard<mutex> trava(travaBuffersPerfil);
+    buffer->idThread = (int)buffersPerfil.size();
+    buffersPerfil.push_back(buffer);
+    return buffer;
+}
+
+inline BufferPerfil &bufferPerfilDaThread()
+{
+    thread_local BufferPerfil *buffer = registrarBufferPerfil();
+    return *buffer;
+}
+
+struct ZonaPerfil
+{
+    const char *nome;
+    uint64_t inicio;
+
+    explicit ZonaPerfil(const char *n) : nome(n), inicio(relogioPerfilNs()) {}
+    ~ZonaPerfil()
+    {
+        BufferPerfil &buffer = bufferPerfilDaThread();
+        uint64_t i = buffer.escritos.load(memory_order_relaxed);
+        buffer.eventos[i % CAPACIDADE_PERFIL] = {nome, inicio, relogioPerfilNs() - inicio};
+        buffer.escritos.store(i + 1, memory_order_release);
+    }
+};
+
+#define PERFIL_CONCAT_(a, b) a##b
+#define PERFIL_CONCAT(a, b) PERFIL_CONCAT_(a, b)
+#define PERFIL_ZONA(nome) ZonaPerfil PERFIL_CONCAT(zonaPerfil, __LINE__)(nome)
+
+void exportarPerfil(const char *motivo)
+{
+    static int nExportacoes = 0;
+    string caminho = "perfil_" + to_string(nExportacoes++) + ".json";
+    ofstream arquivo(caminho);
+    if (!arquivo.is_open())
+        return;
+
+    vector<BufferPerfil *> buffers;
+    {
+        lock_guard<mutex> trava(travaBuffersPerfil);
+        buffers = buffersPerfil;
+    }
+
+    arquivo << "{\"traceEvents\":[\n";
+    bool primeiro = true;
+    for (BufferPerfil *buffer : buffers)
+    {
+        // Copia o que estiver no anel e depois descarta o trecho que o produtor possa ter sobrescrito
+        uint64_t fim = buffer->escritos.load(memory_order_acquire);
+        uint64_t inicio = fim > CAPACIDADE_PERFIL ? fim - CAPACIDADE_PERFIL : 0;
+        vector<EventoPerfil> copia;
+        for (uint64_t i = inicio; i < fim; i++)
+            copia.push_back(buffer->eventos[i % CAPACIDADE_PERFIL]);
+        uint64_t fimDepois = buffer->escritos.load(memory_order_acquire);
+        uint64_t validosDesde = fimDepois > CAPACIDADE_PERFIL ? fimDepois - CAPACIDADE_PERFIL : 0;
+
+        for (uint64_t i = std::max(inicio, validosDesde); i < fim; i++)
+        {
+            const EventoPerfil &e = copia[i - inicio];
+            arquivo << (primeiro ? "" : ",\n") << "{\"name\":\"" << e.nome << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                    << buffer->idThread << ",\"ts\":" << e.inicioNs / 1000.0 << ",\"dur\":" << e.duracaoNs / 1000.0 << "}";
+            primeiro = false;
+        }
+    }
+    arquivo << "\n]}\n";
+    std::cout << "Perfil exportado (" << motivo << "): " << caminho << std::endl;
+}
+
+#else
+
+#define PERFIL_ZONA(nome)
+
+inline void exportarPerfil(const char *motivo)
+{
+    std::cout << "Profiler desativado: compile com -DPERFIL_CPU=ON" << std::endl;
+}
+
+#endif
+
+// ================================
+// Instrumentação das chamadas GL (contagem e estado redundante)
+// ================================
+// Compilada só com INSTRUMENTAR_GL definido (opção INSTRUMENTAR_GL do CMake). Depois do
+// gladLoadGLLoader, os ponteiros glad_gl* das funções listadas em ENVOLVER_GL são trocados por
+// envoltórios que contam as chamadas de cada função por quadro, espelham o estado (programa, VAO,
+// texturas por unidade, buffers, enable/disable, blend, depth, valores de uniform) para detectar
+// chamadas que não mudam nada, e somam os bytes enviados para a GPU. F4 mostra o último quadro.
+
+#ifdef INSTRUMENTAR_GL
+
+const int GL_CATEGORIA_OUTRA = 0;
+const int GL_CATEGORIA_DESENHO = 1;
+const int GL_CATEGORIA_ESTADO = 2;
+const int GL_CATEGORIA_UNIFORM = 3;
+
+struct FuncaoGL
+{
+    const char *nome;
+    int categoria;
+    uint64_t chamadas = 0;    // no quadro atual
+    uint64_t redundantes = 0;
+    uint64_t chamadasUltimo = 0; // no último quadro completo
+    uint64_t redundantesUltimo = 0;
+};
+
+struct QuadroGL
+{
+    uint64_t chamadas = 0, desenhos = 0, mudancasEstado = 0, uniforms = 0, redundantes = 0, bytesEnviados = 0;
+};
+
+struct InstrumentacaoGL
+{
+    vector<FuncaoGL> funcoes;
+    QuadroGL atual, ultimo;
+
+    // Estado espelhado; o que não está aqui ainda é desconhecido e nunca conta como redundante
+    GLuint programa = 0;
+    bool programaConhecido = false;
+    GLenum unidade = GL_TEXTURE0;
+    unordered_map<uint64_t, GLuint> vinculos;  // (alvo, unidade) -> objeto; VAO usa alvo 0
+    unordered_map<GLenum, bool> habilitado;
+    unordered_map<uint64_t, string> uniforms; // (programa, location) -> bytes do valor
+    GLenum blend[4] = {0, 0, 0, 0};
+    GLenum depthFunc = 0;
+};
+
+InstrumentacaoGL instrumentacaoGL;
+
+int registrarFuncaoGL(const char *nome)
+{
+    string n = nome;
+    int categoria = GL_CATEGORIA_OUTRA;
+    if (n.rfind("glDraw", 0) == 0 || n.rfind("glMultiDraw", 0) == 0)
+        categoria = GL_CATEGORIA_DESENHO;
+    else if (n.rfind("glUniform", 0) == 0)
+        categoria = GL_CATEGORIA_UNIFORM;
+    else if (n.rfind("glBind", 0) == 0 || n == "glUseProgram" || n == "glActiveTexture" || n == "glEnable"
+             || n == "glDisable" || n == "glBlendFunc" || n == "glBlendFuncSeparate" || n == "glDepthFunc" || n == "glDepthMask"
+             || n == "glColorMask" || n == "glViewport" || n == "glScissor")
+        categoria = GL_CATEGORIA_ESTADO;
+    FuncaoGL f;
+    f.nome = nome;
+    f.categoria = categoria;
+    instrumentacaoGL.funcoes.push_back(f);
+    return (int)instrumentacaoGL.funcoes.size() - 1;
+}
+
+void contarChamadaGL(int id, bool redundante)
+{
+    FuncaoGL &f = instrumentacaoGL.funcoes[id];
+    QuadroGL &q = instrumentacaoGL.atual;
+    f.chamadas++;
+    q.chamadas++;
+    if (f.categoria == GL_CATEGORIA_DESENHO)
+        q.desenhos++;
+    else if (f.categoria == GL_CATEGORIA_ESTADO)
+        q.mudancasEstado++;
+    else if (f.categoria == GL_CATEGORIA_UNIFORM)
+        q.uniforms++;
+    if (redundante)
+    {
+        f.redundantes++;
+        q.redundantes++;
+    }
+}
+
+// Troca o valor espelhado e diz se ele já era o mesmo
+template <typename Mapa, typename Chave, typename Valor>
+bool atualizarEspelho(Mapa &mapa, const Chave &chave, const Valor &valor)
+{
+    auto it = mapa.find(chave);
+    if (it != mapa.end() && it->second == valor)
+        return true;
+    mapa[chave] = valor;
+    return false;
+}
+
+bool uniformRedundante(GLint location, const void *dados, size_t tamanho)
+{
+    InstrumentacaoGL &g = instrumentacaoGL;
+    if (location < 0 || !g.programaConhecido)
+        return false;
+    uint64_t chave = ((uint64_t)g.programa << 32) | (uint32_t)location;
+    return atualizarEspelho(g.uniforms, chave, string((const char *)dados, tamanho));
+}
+
+size_t bytesPorPixelGL(GLenum formato, GLenum tipo)
+{
+    size_t componentes = 4;
+    if (formato == GL_RED)
+        componentes = 1;
+    else if (formato == GL_RG)
+        componentes = 2;
+    else if (formato == GL_RGB || formato == GL_BGR)
+        componentes = 3;
+    return componentes * (tipo == GL_FLOAT ? 4 : 1);
+}
+
+// Com um PBO vinculado, o envio já foi contado quando o buffer foi preenchido
+bool pboDeEnvioVinculado()
+{
+    auto it = instrumentacaoGL.vinculos.find((uint64_t)GL_PIXEL_UNPACK_BUFFER << 32);
+    return it != instrumentacaoGL.vinculos.end() && it->second != 0;
+}
+
+// Observadores: um por função com semântica especial; o resto só conta chamadas.
+// Devolvem true quando a chamada não muda o estado.
+template <auto *Ponteiro> struct TagGL {};
+
+template <auto *Ponteiro, typename... A> bool observarGL(TagGL<Ponteiro>, A...) { return false; }
+
+bool observarGL(TagGL<&glad_glUseProgram>, GLuint programa)
+{
+    InstrumentacaoGL &g = instrumentacaoGL;
+    bool redundante = g.programaConhecido && g.programa == programa;
+    g.programa = programa;
+    g.programaConhecido = true;
+    return redundante;
+}
+
+bool observarGL(TagGL<&glad_glActiveTexture>, GLenum unidade)
+{
+    bool redundante = instrumentacaoGL.unidade == unidade;
+    instrumentacaoGL.unidade = unidade;
+    return redundante;
+}
+
+bool observarGL(TagGL<&glad_glBindTexture>, GLenum alvo, GLuint textura)
+{
+    uint64_t chave = ((uint64_t)alvo << 32) | (instrumentacaoGL.unidade - GL_TEXTURE0 + 1);
+    return atualizarEspelho(instrumentacaoGL.vinculos, chave, textura);
+}
+
+bool observarGL(TagGL<&glad_glBindVertexArray>, GLuint vao)
+{
+    // O vínculo do GL_ELEMENT_ARRAY_BUFFER faz parte do VAO
+    instrumentacaoGL.vinculos.erase((uint64_t)GL_ELEMENT_ARRAY_BUFFER << 32);
+    return atualizarEspelho(instrumentacaoGL.vinculos, (uint64_t)0, vao);
+}
+
+bool observarGL(TagGL<&glad_glBindBuffer>, GLenum alvo, GLuint buffer)
+{
+    return atualizarEspelho(instrumentacaoGL.vinculos, (uint64_t)alvo << 32, buffer);
+}
+
+// Leitura e desenho têm vínculos separados; GL_FRAMEBUFFER troca os dois e só é redundante se ambos já eram fbo
+bool observarGL(TagGL<&glad_glBindFramebuffer>, GLenum alvo, GLuint fbo)
+{
+    auto espelhar = [fbo](GLenum alvoUnico) {
+        return atualizarEspelho(instrumentacaoGL.vinculos, ((uint64_t)alvoUnico << 32) | 0xFFFF, fbo);
+    };
+    if (alvo != GL_FRAMEBUFFER)
+        return espelhar(alvo);
+    bool leitura = espelhar(GL_READ_FRAMEBUFFER);
+    bool desenho = espelhar(GL_DRAW_FRAMEBUFFER);
+    return leitura && desenho;
+}
+
+bool observarGL(TagGL<&glad_glBindRenderbuffer>, GLenum alvo, GLuint rbo)
+{
+    return atualizarEspelho(instrumentacaoGL.vinculos, (uint64_t)alvo << 32, rbo);
+}
+
+bool observarGL(TagGL<&glad_glEnable>, GLenum cap)
+{
+    return atualizarEspelho(instrumentacaoGL.habilitado, cap, true);
+}
+
+bool observarGL(TagGL<&glad_glDisable>, GLenum cap)
+{
+    return atualizarEspelho(instrumentacaoGL.habilitado, cap, false);
+}
+
+bool observarGL(TagGL<&glad_glBlendFuncSeparate>, GLenum origemCor, GLenum destinoCor, GLenum origemAlfa,
+                GLenum destinoAlfa)
+{
+    GLenum *b = instrumentacaoGL.blend;
+    bool redundante = b[0] == origemCor && b[1] == destinoCor && b[2] == origemAlfa && b[3] == destinoAlfa;
+    b[0] = origemCor;
+    b[1] = destinoCor;
+    b[2] = origemAlfa;
+    b[3] = destinoAlfa;
+    return redundante;
+}
+
+bool observarGL(TagGL<&glad_glBlendFunc>, GLenum origem, GLenum destino)
+{
+    return observarGL(TagGL<&glad_glBlendFuncSeparate>(), origem, destino, origem, destino);
+}
+
+bool observarGL(TagGL<&glad_glDepthFunc>, GLenum funcao)
+{
+    bool redundante = instrumentacaoGL.depthFunc == funcao;
+    instrumentacaoGL.depthFunc = funcao;
+    return redundante;
+}
+
+bool observarGL(TagGL<&glad_glUniform1i>, GLint location, GLint v)
+{
+    return uniformRedundante(location, &v, sizeof(v));
+}
+
+bool observarGL(TagGL<&glad_glUniform1f>, GLint location, GLfloat v)
+{
+    return uniformRedundante(location, &v, sizeof(v));
+}
+
+bool observarGL(TagGL<&glad_glUniform2f>, GLint location, GLfloat v0, GLfloat v1)
+{
+    GLfloat v[2] = {v0, v1};
+    return uniformRedundante(location, v, sizeof(v));
+}
+
+bool observarGL(TagGL<&glad_glUniform4f>, GLint location, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+{
+    GLfloat v[4] = {v0, v1, v2, v3};
+    return uniformRedundante(location, v, sizeof(v));
+}
+
+bool observarGL(TagGL<&glad_glUniform4fv>, GLint location, GLsizei n, const GLfloat *v)
+{
+    return uniformRedundante(location, v, n * 4 * sizeof(GLfloat));
+}
+
+bool observarGL(TagGL<&glad_glUniformMatrix4fv>, GLint location, GLsizei n, GLboolean transposta, const GLfloat *v)
+{
+    return uniformRedundante(location, v, n * 16 * sizeof(GLfloat));
+}
+
+bool observarGL(TagGL<&glad_glBufferData>, GLenum alvo, GLsizeiptr tamanho, const void *dados, GLenum uso)
+{
+    if (dados)
+        instrumentacaoGL.atual.bytesEnviados += tamanho;
+    return false;
+}
+
+bool observarGL(TagGL<&glad_glBufferSubData>, GLenum alvo, GLintptr offset, GLsizeiptr tamanho, const void *dados)
+{
+    instrumentacaoGL.atual.bytesEnviados += tamanho;
+    return false;
+}
+
+bool observarGL(TagGL<&glad_glMapBufferRange>, GLenum alvo, GLintptr offset, GLsizeiptr tamanho, GLbitfield acesso)
+{
+    if (acesso & GL_MAP_WRITE_BIT)
+        instrumentacaoGL.atual.bytesEnviados += tamanho;
+    return false;
+}
+
+bool observarGL(TagGL<&glad_glTexImage2D>, GLenum alvo, GLint nivel, GLint formatoInterno, GLsizei largura,
+                GLsizei altura, GLint borda, GLenum formato, GLenum tipo, const void *pixels)
+{
+    if (pixels && !pboDeEnvioVinculado())
+        instrumentacaoGL.atual.bytesEnviados += (uint64_t)largura * altura * bytesPorPixelGL(formato, tipo);
+    return false;
+}
+
+bool observarGL(TagGL<&glad_glTexSubImage2D>, GLenum alvo, GLint nivel, GLint x, GLint y, GLsizei largura,
+                GLsizei altura, GLenum formato, GLenum tipo, const void *pixels)
+{
+    if (!pboDeEnvioVinculado())
+        instrumentacaoGL.atual.bytesEnviados += (uint64_t)largura * altura * bytesPorPixelGL(formato, tipo);
+    return false;
+}
+
+bool observarGL(TagGL<&glad_glTexImage3D>, GLenum alvo, GLint nivel, GLint formatoInterno, GLsizei largura,
+                GLsizei altura, GLsizei profundidade, GLint borda, GLenum formato, GLenum tipo, const void *pixels)
+{
+    if (pixels && !pboDeEnvioVinculado())
+        instrumentacaoGL.atual.bytesEnviados +=
+            (uint64_t)largura * altura * profundidade * bytesPorPixelGL(formato, tipo);
+    return false;
+}
+
+bool observarGL(TagGL<&glad_glTexSubImage3D>, GLenum alvo, GLint nivel, GLint x, GLint y, GLint z, GLsizei largura,
+                GLsizei altura, GLsizei profundidade, GLenum formato, GLenum tipo, const void *pixels)
+{
+    if (!pboDeEnvioVinculado())
+        instrumentacaoGL.atual.bytesEnviados +=
+            (uint64_t)largura * altura * profundidade * bytesPorPixelGL(formato, tipo);
+    return false;
+}
+
+template <auto *Ponteiro, typename F> struct EnvoltorioGL;
+
+template <auto *Ponteiro, typename R, typename... A> struct EnvoltorioGL<Ponteiro, R(APIENTRYP)(A...)>
+{
+    static inline R(APIENTRYP original)(A...) = nullptr;
+    static inline int id = -1;
+
+    static R APIENTRY chamar(A... args)
+    {
+        contarChamadaGL(id, observarGL(TagGL<Ponteiro>(), args...));
+        return original(args...);
+    }
+};
+
+template <auto *Ponteiro> void envolverGL(const char *nome)
+{
+    using Envoltorio = EnvoltorioGL<Ponteiro, std::remove_pointer_t<decltype(Ponteiro)>>;
+    if (*Ponteiro == nullptr || Envoltorio::original != nullptr)
+        return; // função ausente no driver, ou já envolvida
+    Envoltorio::original = *Ponteiro;
+    Envoltorio::id = registrarFuncaoGL(nome);
+    *Ponteiro = &Envoltorio::chamar;
+}
+
+#define ENVOLVER_GL(funcao) envolverGL<&glad_##funcao>(#funcao)
+
+void instalarInstrumentacaoGL()
+{
+    // Estado
+    ENVOLVER_GL(glUseProgram);
+    ENVOLVER_GL(glActiveTexture);
+    ENVOLVER_GL(glBindTexture);
+    ENVOLVER_GL(glBindVertexArray);
+    ENVOLVER_GL(glBindBuffer);
+    ENVOLVER_GL(glBindFramebuffer);
+    ENVOLVER_GL(glBindRenderbuffer);
+    ENVOLVER_GL(glEnable);
+    ENVOLVER_GL(glDisable);
+    ENVOLVER_GL(glBlendFunc);
+    ENVOLVER_GL(glBlendFuncSeparate);
+    ENVOLVER_GL(glDepthFunc);
+    ENVOLVER_GL(glDepthMask);
+    ENVOLVER_GL(glColorMask);
+    ENVOLVER_GL(glViewport);
+    ENVOLVER_GL(glScissor);
+
+    // Uniforms
+    ENVOLVER_GL(glGetUniformLocation);
+    ENVOLVER_GL(glUniform1i);
+    ENVOLVER_GL(glUniform1f);
+    ENVOLVER_GL(glUniform2f);
+    ENVOLVER_GL(glUniform4f);
+    ENVOLVER_GL(glUniform4fv);
+    ENVOLVER_GL(glUniformMatrix4fv);
+
+    // Desenho
+    ENVOLVER_GL(glDrawArrays);
+    ENVOLVER_GL(glDrawElements);
+    ENVOLVER_GL(glDrawArraysInstanced);
+    ENVOLVER_GL(glDrawElementsInstanced);
+    ENVOLVER_GL(glClear);
+    ENVOLVER_GL(glBlitFramebuffer);
+
+    // Envio de dados
+    ENVOLVER_GL(glBufferData);
+    ENVOLVER_GL(glBufferSubData);
+    ENVOLVER_GL(glMapBufferRange);
+    ENVOLVER_GL(glUnmapBuffer);
+    ENVOLVER_GL(glTexImage2D);
+    ENVOLVER_GL(glTexSubImage2D);
+    ENVOLVER_GL(glTexImage3D);
+    ENVOLVER_GL(glTexSubImage3D);
+    ENVOLVER_GL(glTexParameteri);
+    ENVOLVER_GL(glGenerateMipmap);
+    ENVOLVER_GL(glPixelStorei);
+
+    // Consultas e criação de objetos
+    ENVOLVER_GL(glQueryCounter);
+    ENVOLVER_GL(glGetQueryObjectiv);
+    ENVOLVER_GL(glGetQueryObjectui64v);
+    ENVOLVER_GL(glGenTextures);
+    ENVOLVER_GL(glDeleteTextures);
+    ENVOLVER_GL(glGenBuffers);
+    ENVOLVER_GL(glGenVertexArrays);
+    ENVOLVER_GL(glGetError);
+    ENVOLVER_GL(glGetIntegerv);
+}
+
+// Fecha as contagens do quadro; chamado logo antes de trocar os buffers
+void fecharQuadroGL()
+{
+    InstrumentacaoGL &g = instrumentacaoGL;
+    for (FuncaoGL &f : g.funcoes)
+    {
+        f.chamadasUltimo = f.chamadas;
+        f.redundantesUltimo = f.redundantes;
+        f.chamadas = f.redundantes = 0;
+    }
+    g.ultimo = g.atual;
+    g.atual = QuadroGL();
+}
+
+string resumoQuadroGL()
+{
+    const QuadroGL &q = instrumentacaoGL.ultimo;
+    return ", " + to_string(q.desenhos) + " draws, " + to_string(q.chamadas) + " chamadas GL";
+}
+
+void relatorioChamadasGL()
+{
+    InstrumentacaoGL &g = instrumentacaoGL;
+    const QuadroGL &q = g.ultimo;
+    std::cout << "Chamadas GL no último quadro: " << q.chamadas << " (" << q.redundantes << " redundantes)" << std::endl;
+    std::cout << "  draw calls: " << q.desenhos << ", mudanças de estado: " << q.mudancasEstado
+              << ", uniforms: " << q.uniforms << ", bytes enviados: " << q.bytesEnviados << std::endl;
+
+    vector<const FuncaoGL *> ordenadas;
+    for (const FuncaoGL &f : g.funcoes)
+        if (f.chamadasUltimo > 0)
+            ordenadas.push_back(&f);
+    sort(ordenadas.begin(), ordenadas.end(),
+         [](const FuncaoGL *a, const FuncaoGL *b) { return a->chamadasUltimo > b->chamadasUltimo; });
+    char linha[128];
+    for (const FuncaoGL *f : ordenadas)
+    {
+        snprintf(linha, sizeof(linha), "  %-26s %8llu  (%llu redundantes)", f->nome,
+                 (unsigned long long)f->chamadasUltimo, (unsigned long long)f->redundantesUltimo);
+        std::cout << linha << std::endl;
+    }
+}
+
+#else
+
+inline void instalarInstrumentacaoGL() {}
+inline void fecharQuadroGL() {}
+inline string resumoQuadroGL() { return ""; }
+
+inline void relatorioChamadasGL()
+{
+    std::cout << "Instrumentação GL desativada: compile com -DINSTRUMENTAR_GL=ON" << std::endl;
+}
+
+#endif
 
 // Protótipos das funções
 int setupShader();
+
+// Código fonte de um programa de shader (vertex + fragment)
+struct FontesPrograma
+{
+    const GLchar *vertex;
+    const GLchar *fragment;
+};
+vector<GLuint> criarProgramas(const vector<FontesPrograma> &fontes);
 int setupSprite(int nAnimations, int nFrames, float &ds, float &dt);
 int setupTile(int nTiles, float &ds, float &dt);
-int loadTexture(string filePath, int &width, int &height);
 void desenharMapa(GLuint shaderID);
-bool isTileInArray(int tileId, const vector<int> tileVector);
+void invalidarCacheMapa();
+void marcarQuadroSujo();
+void desenharQuadro(GLFWwindow *window);
+void desenharPrincipal(GLuint shaderID);
+void desenharMoeda(GLuint shaderID);
+void desenharObjetos(GLuint shaderID, bool opacos);
+bool isTileInArray(int tileId, const vector<int> &tileVector);
 void finalizarJogo();
 void popularVectorComDigitosAgrupados(const std::string& str_de_digitos, std::vector<int>& target_vector);
+void registrarTamanhoTextura(GLuint texID, size_t bytes);
+void registrarFalhaTextura(GLuint texID);
+GLuint texturaGL(int handle);
+
+// Conteúdo de um asset: aponta para dentro de assets.bundle ou para o arquivo solto lido em armazenamento
+struct VisaoAsset
+{
+    const unsigned char *dados = nullptr;
+    size_t tamanho = 0;
+    vector<unsigned char> armazenamento;
+};
+bool abrirAsset(const string &nome, VisaoAsset &visao);
+string resolverCaminho(const string &nome);
+string raizProjeto();
 
 vector<vector<int>> map;
 int TILEMAP_WIDTH = 0, TILEMAP_HEIGHT = 0;
@@ -60,12 +681,21 @@ int COIN_HEIGHT;
 int COIN_WIDTH;
 
 void carregarMapaTxt(const string& path) {
+    PERFIL_ZONA("carregarMapaTxt");
 
-    ifstream file(path);
-    if (!file.is_open()) {
+    VisaoAsset asset;
+    if (!abrirAsset(path, asset)) {
         cerr << "Erro ao abrir o arquivo do mapa: " << path << "\n";
         exit(1);  // ENCERRA imediatamente se o mapa não foi encontrado
     }
+    istringstream file(string((const char *)asset.dados, asset.tamanho));
+
+    // Permite carregar vários mapas em sequência (ex.: verificação de níveis)
+    map.clear();
+    NOT_WALKABLE_TILES.clear();
+    DANGEROUS_TILES.clear();
+    selectedTileMapLine = selectedTileMapColumn = 0;
+    COIN_LINE = COIN_COLUMN = 0;
 
     file >> TILESET_FILENAME;
 
@@ -165,83 +795,4059 @@ void popularVectorComDigitosAgrupados(const std::string& str_de_digitos, std::ve
     }
 }
 
-struct Sprite
-{
-    GLuint VAO;
-    GLuint texID;
-    vec3 position;
-    vec3 dimensions; // tamanho do frame
+// ================================
+// Regras de movimento compartilhadas (jogo, ambiente de treino, etc.)
+// ================================
 
-    bool isAnimated;
-    float ds, dt;
-    int iAnimation, iFrame;
-	int nAnimations, nFrames;
-    bool isAlive = true;
-    bool isCollect = false;
+// Os 8 movimentos do personagem, na mesma ordem das teclas tratadas em key_callback
+// (A, D, W, S, E, Q, C, Z). Cada linha é {deslocamento na linha, deslocamento na coluna, animação}
+const int NUM_MOVIMENTOS = 8;
+const int MOVIMENTOS[NUM_MOVIMENTOS][3] = {
+    { 1, -1, 3}, // A
+    {-1,  1, 4}, // D
+    { 1,  1, 2}, // W
+    {-1, -1, 1}, // S
+    { 0,  1, 4}, // E
+    { 1,  0, 3}, // Q
+    {-1,  0, 4}, // C
+    { 0, -1, 3}  // Z
+};
+const int TECLAS_MOVIMENTO[NUM_MOVIMENTOS] = {
+    GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_E, GLFW_KEY_Q, GLFW_KEY_C, GLFW_KEY_Z
 };
 
-Sprite principal;
-Sprite coin;
+// Classificação de cada id de tile, calculada uma vez a partir das listas do Mapa.txt
+const unsigned char TILE_NAO_CAMINHAVEL = 1;
+const unsigned char TILE_PERIGOSO = 2;
+const unsigned char TILE_FINAL = 4;
+const int MAX_ID_TILE = 16;
 
-struct Tile
+// Eventos que podem acontecer em um passo
+const int EVENTO_MORTE = 1;
+const int EVENTO_MOEDA = 2;
+const int EVENTO_FINAL = 4;
+const int EVENTO_FINAL_SEM_MOEDA = 8;
+
+// Cópia imutável de um mapa carregado: serve de modelo para reiniciar instâncias sem reler o arquivo
+struct ModeloMapa
 {
-    GLuint VAO;
-    GLuint texID; // de qual tileset
-    int iTile;    // indice dele no tileset
-    vec3 position;
-    vec3 dimensions; // tamanho do losango 2:1
-    float ds, dt;
-    int iAnimation, iFrame;
-    int nAnimations, nFrames;
+    int linhas = 0, colunas = 0;
+    vector<unsigned char> celulas; // linhas * colunas, linha a linha
+    unsigned char tipoTile[MAX_ID_TILE] = {};
+    int linhaInicial = 1, colunaInicial = 1; // 1-based, como selectedTileMapLine/Column
+    int linhaMoeda = 0, colunaMoeda = 0;
+    int tileCaminhado = 0;
+
+    unsigned char tipo(int valor) const
+    {
+        return (valor >= 0 && valor < MAX_ID_TILE) ? tipoTile[valor] : 0;
+    }
 };
 
-// Protótipo da função de callback de teclado
-void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode);
+ModeloMapa modeloMapa;
 
-// Dimensões da janela (pode ser alterado em tempo de execução)
-const GLuint WIDTH = 1200, HEIGHT = 800;
+ModeloMapa criarModeloDoMapaAtual()
+{
+    ModeloMapa modelo;
+    modelo.linhas = TILEMAP_HEIGHT;
+    modelo.colunas = TILEMAP_WIDTH;
+    modelo.celulas.resize(TILEMAP_HEIGHT * TILEMAP_WIDTH);
+    for (int i = 0; i < TILEMAP_HEIGHT; i++)
+        for (int j = 0; j < TILEMAP_WIDTH; j++)
+            modelo.celulas[i * TILEMAP_WIDTH + j] = (unsigned char)map[i][j];
 
-// Código fonte do Vertex Shader (em GLSL): ainda hardcoded
-const GLchar *vertexShaderSource = R"(
- #version 400
- layout (location = 0) in vec3 position;
- layout (location = 1) in vec2 texc;
- out vec2 tex_coord;
- uniform mat4 model;
- uniform mat4 projection;
- void main()
- {
-	tex_coord = vec2(texc.s, 1.0 - texc.t);
-	gl_Position = projection * model * vec4(position, 1.0);
- }
- )";
+    for (int t = 0; t < MAX_ID_TILE; t++)
+    {
+        if (isTileInArray(t, NOT_WALKABLE_TILES)) modelo.tipoTile[t] |= TILE_NAO_CAMINHAVEL;
+        if (isTileInArray(t, DANGEROUS_TILES)) modelo.tipoTile[t] |= TILE_PERIGOSO;
+        if (t == FINAL_TITLE) modelo.tipoTile[t] |= TILE_FINAL;
+    }
+
+    modelo.linhaInicial = selectedTileMapLine;
+    modelo.colunaInicial = selectedTileMapColumn;
+    modelo.linhaMoeda = COIN_LINE;
+    modelo.colunaMoeda = COIN_COLUMN;
+    modelo.tileCaminhado = WALKED_TILE;
+    return modelo;
+}
+
+// Célula escrita por um passo (para manter hashes e snapshots incrementalmente)
+struct AlteracaoCelula
+{
+    int indice = -1; // linha * colunas + coluna (0-based); -1 se nada foi escrito
+    int anterior = 0;
+    int novo = 0;
+};
+
+// Aplica as regras de key_callback a um estado qualquer e devolve os eventos (EVENTO_*).
+// celula(i, j) devolve uma referência para a célula (0-based) do mapa sendo simulado;
+// linha e coluna são 1-based, como selectedTileMapLine/selectedTileMapColumn.
+template <typename AcessoCelula>
+int aplicarRegrasMovimento(const ModeloMapa &modelo, AcessoCelula celula, int &linha, int &coluna,
+                           bool &moedaColetada, int dLinha, int dColuna, AlteracaoCelula *alteracao = nullptr)
+{
+    int eventos = 0;
+
+    int possivelLinha = glm::clamp(linha + dLinha, 1, modelo.linhas);
+    int possivelColuna = glm::clamp(coluna + dColuna, 1, modelo.colunas);
+
+    if (!(modelo.tipo(celula(possivelLinha - 1, possivelColuna - 1)) & TILE_NAO_CAMINHAVEL))
+    {
+        linha = possivelLinha;
+        coluna = possivelColuna;
+    }
+
+    auto &atual = celula(linha - 1, coluna - 1);
+
+    if (modelo.tipo(atual) & TILE_PERIGOSO)
+    {
+        eventos |= EVENTO_MORTE;
+    }
+
+    if (coluna == modelo.colunaMoeda && linha == modelo.linhaMoeda && !moedaColetada)
+    {
+        moedaColetada = true;
+        eventos |= EVENTO_MOEDA;
+    }
+
+    if (modelo.tipo(atual) & TILE_FINAL)
+    {
+        eventos |= moedaColetada ? EVENTO_FINAL : EVENTO_FINAL_SEM_MOEDA;
+    }
+    else
+    {
+        if (alteracao)
+        {
+            alteracao->indice = (linha - 1) * modelo.colunas + (coluna - 1);
+            alteracao->anterior = atual;
+            alteracao->novo = modelo.tileCaminhado;
+        }
+        atual = modelo.tileCaminhado;
+    }
+
+    return eventos;
+}
+
+// ================================
+// Hash Zobrist do estado do jogo
+// ================================
+// Impressão digital de 64 bits do mapa (incluindo o rastro caminhado), da posição do
+// personagem e da moeda. As chaves são geradas de forma determinística a partir do tamanho
+// do mapa, então duas máquinas com o mesmo mapa produzem os mesmos hashes (replays, rede).
+
+struct TabelaZobrist
+{
+    int nCelulas = 0;
+    vector<uint64_t> chavesCelula;  // nCelulas * MAX_ID_TILE
+    vector<uint64_t> chavesPosicao; // nCelulas
+    uint64_t chaveMoeda = 0;
+
+    uint64_t celula(int indice, int valor) const
+    {
+        return chavesCelula[indice * MAX_ID_TILE + (valor & (MAX_ID_TILE - 1))];
+    }
+};
+
+TabelaZobrist zobrist;
+uint64_t hashEstado = 0;
+
+// splitmix64: gerador pequeno e reprodutível em qualquer plataforma
+uint64_t proximoSplitMix64(uint64_t &semente)
+{
+    uint64_t z = (semente += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+TabelaZobrist criarTabelaZobrist(int nCelulas)
+{
+    TabelaZobrist tabela;
+    uint64_t semente = 0x5A0B1517ull ^ (uint64_t)nCelulas;
+    tabela.nCelulas = nCelulas;
+    tabela.chavesCelula.resize((size_t)nCelulas * MAX_ID_TILE);
+    for (uint64_t &chave : tabela.chavesCelula)
+        chave = proximoSplitMix64(semente);
+    tabela.chavesPosicao.resize(nCelulas);
+    for (uint64_t &chave : tabela.chavesPosicao)
+        chave = proximoSplitMix64(semente);
+    tabela.chaveMoeda = proximoSplitMix64(semente);
+    return tabela;
+}
+
+// Hash completo, O(linhas * colunas). Usado na inicialização e para conferir o hash incremental.
+template <typename AcessoCelula>
+uint64_t calcularHashCompleto(const TabelaZobrist &tabela, AcessoCelula celula, int linhas, int colunas,
+                              int linha, int coluna, bool moedaColetada)
+{
+    uint64_t hash = 0;
+    for (int i = 0; i < linhas; i++)
+        for (int j = 0; j < colunas; j++)
+            hash ^= tabela.celula(i * colunas + j, celula(i, j));
+    hash ^= tabela.chavesPosicao[(linha - 1) * colunas + (coluna - 1)];
+    if (moedaColetada)
+        hash ^= tabela.chaveMoeda;
+    return hash;
+}
+
+// Atualização O(1) depois de um passo: posições são índices 0-based de célula
+uint64_t atualizarHash(uint64_t hash, const TabelaZobrist &tabela, int posicaoAntes, int posicaoDepois,
+                       bool moedaAntes, bool moedaDepois, const AlteracaoCelula &alteracao)
+{
+    if (posicaoAntes != posicaoDepois)
+        hash ^= tabela.chavesPosicao[posicaoAntes] ^ tabela.chavesPosicao[posicaoDepois];
+    if (moedaAntes != moedaDepois)
+        hash ^= tabela.chaveMoeda;
+    if (alteracao.indice >= 0)
+        hash ^= tabela.celula(alteracao.indice, alteracao.anterior) ^ tabela.celula(alteracao.indice, alteracao.novo);
+    return hash;
+}
+
+// ================================
+// Pool de threads simples
+// ================================
+
+class PoolDeThreads
+{
+public:
+    explicit PoolDeThreads(unsigned nThreads = 0)
+    {
+        if (nThreads == 0)
+            nThreads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned i = 0; i < nThreads; i++)
+            threads.emplace_back([this] { laco(); });
+    }
+
+    ~PoolDeThreads()
+    {
+        {
+            lock_guard<mutex> trava(m);
+            encerrando = true;
+        }
+        cv.notify_all();
+        for (thread &t : threads)
+            t.join();
+    }
+
+    unsigned tamanho() const { return (unsigned)threads.size(); }
+
+    void enfileirar(function<void()> tarefa)
+    {
+        {
+            lock_guard<mutex> trava(m);
+            fila.push_back(std::move(tarefa));
+        }
+        cv.notify_one();
+    }
+
+    // Divide [0, n) em blocos, executa func(inicio, fim) para cada um e espera todos terminarem.
+    // Enquanto espera, a thread chamadora também consome tarefas da fila, então é seguro
+    // chamar paraCada de dentro de uma tarefa do próprio pool.
+    void paraCada(int n, const function<void(int, int)> &func)
+    {
+        if (n <= 0)
+            return;
+
+        int nBlocos = std::min(n, (int)tamanho() + 1);
+        if (nBlocos == 1)
+        {
+            func(0, n);
+            return;
+        }
+
+        atomic<int> restantes(nBlocos - 1);
+        for (int b = 1; b < nBlocos; b++)
+        {
+            int inicio = (int)((long long)n * b / nBlocos);
+            int fim = (int)((long long)n * (b + 1) / nBlocos);
+            enfileirar([&func, &restantes, inicio, fim] {
+                func(inicio, fim);
+                restantes.fetch_sub(1, memory_order_release);
+            });
+        }
+
+        func(0, (int)((long long)n / nBlocos));
+
+        while (restantes.load(memory_order_acquire) > 0)
+        {
+            if (!executarUmaTarefa())
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    vector<thread> threads;
+    deque<function<void()>> fila;
+    mutex m;
+    condition_variable cv;
+    bool encerrando = false;
+
+    bool executarUmaTarefa()
+    {
+        function<void()> tarefa;
+        {
+            lock_guard<mutex> trava(m);
+            if (fila.empty())
+                return false;
+            tarefa = std::move(fila.front());
+            fila.pop_front();
+        }
+        tarefa();
+        return true;
+    }
+
+    void laco()
+    {
+        while (true)
+        {
+            function<void()> tarefa;
+            {
+                unique_lock<mutex> trava(m);
+                cv.wait(trava, [this] { return encerrando || !fila.empty(); });
+                if (encerrando && fila.empty())
+                    return;
+                tarefa = std::move(fila.front());
+                fila.pop_front();
+            }
+            tarefa();
+        }
+    }
+};
+
+PoolDeThreads &poolGlobal()
+{
+    static PoolDeThreads pool;
+    return pool;
+}
+
+// ================================
+// Ambiente vetorizado para treino de agentes (estilo gym)
+// ================================
+// N instâncias independentes do jogo guardadas em estrutura de arrays (SoA). Cada passo
+// recebe uma ação (índice em MOVIMENTOS) por instância e produz observações, recompensas
+// e flags de término em buffers contíguos, prontos para virar tensores.
+
+const unsigned char OBS_JOGADOR = 254; // valor da célula do personagem na observação
+const unsigned char OBS_MOEDA = 253;   // valor da célula da moeda (enquanto não coletada)
+
+const float RECOMPENSA_PASSO = -0.01f;
+const float RECOMPENSA_MOEDA = 1.0f;
+const float RECOMPENSA_FINAL = 10.0f;
+const float RECOMPENSA_MORTE = -10.0f;
+const int MAX_PASSOS_EPISODIO = 500;
+
+struct AmbienteVetorizado
+{
+    const ModeloMapa *modelo = nullptr;
+    int nAmbientes = 0;
+    int tamanhoMapa = 0; // linhas * colunas
+
+    vector<unsigned char> mapas;       // N x linhas x colunas (estado, inclui o rastro caminhado)
+    vector<unsigned char> observacoes; // N x linhas x colunas (mapa + personagem + moeda)
+    vector<int> linha, coluna;         // 1-based
+    vector<unsigned char> moedaColetada;
+    vector<unsigned char> terminado;
+    vector<float> recompensas;
+    vector<int> passos;
+    vector<uint64_t> hashes; // hash Zobrist de cada instância
+
+    TabelaZobrist zobrist;
+    uint64_t hashInicial = 0;
+};
+
+void atualizarObservacao(AmbienteVetorizado &amb, int indice)
+{
+    const ModeloMapa &modelo = *amb.modelo;
+    unsigned char *obs = &amb.observacoes[(size_t)indice * amb.tamanhoMapa];
+    memcpy(obs, &amb.mapas[(size_t)indice * amb.tamanhoMapa], amb.tamanhoMapa);
+    if (!amb.moedaColetada[indice])
+        obs[(modelo.linhaMoeda - 1) * modelo.colunas + (modelo.colunaMoeda - 1)] = OBS_MOEDA;
+    obs[(amb.linha[indice] - 1) * modelo.colunas + (amb.coluna[indice] - 1)] = OBS_JOGADOR;
+}
+
+void reiniciarAmbiente(AmbienteVetorizado &amb, int indice)
+{
+    const ModeloMapa &modelo = *amb.modelo;
+    unsigned char *mapa = &amb.mapas[(size_t)indice * amb.tamanhoMapa];
+    memcpy(mapa, modelo.celulas.data(), amb.tamanhoMapa);
+
+    amb.linha[indice] = modelo.linhaInicial;
+    amb.coluna[indice] = modelo.colunaInicial;
+    mapa[(modelo.linhaInicial - 1) * modelo.colunas + (modelo.colunaInicial - 1)] = (unsigned char)modelo.tileCaminhado;
+    amb.moedaColetada[indice] = 0;
+    amb.terminado[indice] = 0;
+    amb.recompensas[indice] = 0.0f;
+    amb.passos[indice] = 0;
+    amb.hashes[indice] = amb.hashInicial;
+    atualizarObservacao(amb, indice);
+}
+
+void criarAmbientes(AmbienteVetorizado &amb, const ModeloMapa &modelo, int nAmbientes)
+{
+    amb.modelo = &modelo;
+    amb.nAmbientes = nAmbientes;
+    amb.tamanhoMapa = modelo.linhas * modelo.colunas;
+    amb.mapas.assign((size_t)nAmbientes * amb.tamanhoMapa, 0);
+    amb.observacoes.assign((size_t)nAmbientes * amb.tamanhoMapa, 0);
+    amb.linha.assign(nAmbientes, 0);
+    amb.coluna.assign(nAmbientes, 0);
+    amb.moedaColetada.assign(nAmbientes, 0);
+    amb.terminado.assign(nAmbientes, 0);
+    amb.recompensas.assign(nAmbientes, 0.0f);
+    amb.passos.assign(nAmbientes, 0);
+    amb.hashes.assign(nAmbientes, 0);
+
+    // Todas as instâncias reiniciam no mesmo estado, então o hash inicial é calculado uma vez
+    amb.zobrist = criarTabelaZobrist(amb.tamanhoMapa);
+    int inicio = (modelo.linhaInicial - 1) * modelo.colunas + (modelo.colunaInicial - 1);
+    amb.hashInicial = calcularHashCompleto(amb.zobrist,
+        [&modelo, inicio](int i, int j) {
+            int indice = i * modelo.colunas + j;
+            return indice == inicio ? modelo.tileCaminhado : (int)modelo.celulas[indice];
+        },
+        modelo.linhas, modelo.colunas, modelo.linhaInicial, modelo.colunaInicial, false);
+
+    for (int i = 0; i < nAmbientes; i++)
+        reiniciarAmbiente(amb, i);
+}
+
+// Avança todas as instâncias um passo; acoes[i] é um índice em MOVIMENTOS.
+// Instâncias que terminaram no passo anterior são reiniciadas automaticamente.
+void passoAmbientes(AmbienteVetorizado &amb, const int *acoes, PoolDeThreads &pool)
+{
+    const ModeloMapa &modelo = *amb.modelo;
+
+    pool.paraCada(amb.nAmbientes, [&](int inicio, int fim) {
+        for (int i = inicio; i < fim; i++)
+        {
+            if (amb.terminado[i])
+                reiniciarAmbiente(amb, i);
+
+            unsigned char *mapa = &amb.mapas[(size_t)i * amb.tamanhoMapa];
+            auto celula = [mapa, &modelo](int l, int c) -> unsigned char & { return mapa[l * modelo.colunas + c]; };
+
+            int acao = glm::clamp(acoes[i], 0, NUM_MOVIMENTOS - 1);
+            bool moedaAntes = amb.moedaColetada[i] != 0;
+            bool moeda = moedaAntes;
+            int posicaoAntes = (amb.linha[i] - 1) * modelo.colunas + (amb.coluna[i] - 1);
+            AlteracaoCelula alteracao;
+            int eventos = aplicarRegrasMovimento(modelo, celula, amb.linha[i], amb.coluna[i], moeda,
+                                                 MOVIMENTOS[acao][0], MOVIMENTOS[acao][1], &alteracao);
+            amb.moedaColetada[i] = moeda;
+            amb.hashes[i] = atualizarHash(amb.hashes[i], amb.zobrist, posicaoAntes,
+                                          (amb.linha[i] - 1) * modelo.colunas + (amb.coluna[i] - 1),
+                                          moedaAntes, moeda, alteracao);
+            amb.passos[i]++;
+
+            float recompensa = RECOMPENSA_PASSO;
+            if (eventos & EVENTO_MOEDA) recompensa += RECOMPENSA_MOEDA;
+            if (eventos & EVENTO_FINAL) recompensa += RECOMPENSA_FINAL;
+            if (eventos & EVENTO_MORTE) recompensa += RECOMPENSA_MORTE;
+            amb.recompensas[i] = recompensa;
+
+            amb.terminado[i] = (eventos & (EVENTO_FINAL | EVENTO_MORTE)) || amb.passos[i] >= MAX_PASSOS_EPISODIO;
+            atualizarObservacao(amb, i);
+        }
+    });
+}
+
+// Modo de linha de comando: roda políticas aleatórias e mede a vazão do ambiente vetorizado
+void medirAmbienteVetorizado(int nAmbientes, int nPassos)
+{
+    AmbienteVetorizado amb;
+    criarAmbientes(amb, modeloMapa, nAmbientes);
+
+    vector<int> acoes(nAmbientes);
+    mt19937 gerador(42);
+    uniform_int_distribution<int> sorteio(0, NUM_MOVIMENTOS - 1);
+
+    int episodios = 0;
+    auto inicio = chrono::steady_clock::now();
+    for (int p = 0; p < nPassos; p++)
+    {
+        for (int i = 0; i < nAmbientes; i++)
+            acoes[i] = sorteio(gerador);
+        passoAmbientes(amb, acoes.data(), poolGlobal());
+        for (int i = 0; i < nAmbientes; i++)
+            episodios += amb.terminado[i];
+    }
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    cout << nAmbientes << " ambientes x " << nPassos << " passos em " << segundos << " s ("
+         << (nAmbientes * (double)nPassos / segundos) << " passos/s, " << episodios << " episodios terminados, "
+         << poolGlobal().tamanho() << " threads)\n";
+}
+
+// ================================
+// Solver: menor sequência segura que coleta a moeda e chega ao tile final
+// ================================
+// BFS em níveis sobre os estados (posição, moeda coletada). Os sucessores são gerados pela
+// própria aplicarRegrasMovimento, então o solver segue exatamente as regras do jogo. As
+// escritas do rastro caminhado são descartadas: o tile caminhado não muda a classificação das
+// células, pois nenhum tile perigoso ou bloqueado é pisado e o tile final nunca é sobrescrito.
+
+const char LETRAS_MOVIMENTO[NUM_MOVIMENTOS + 1] = "ADWSEQCZ";
+const size_t LIMIAR_FRONTEIRA_PARALELA = 4096; // abaixo disso expandir em paralelo não compensa
+
+struct SolucaoNivel
+{
+    bool resolvido = false;
+    int passos = -1;   // "par" do nível
+    string movimentos; // teclas, na ordem
+};
+
+SolucaoNivel resolverNivel(const ModeloMapa &modelo, PoolDeThreads &pool)
+{
+    SolucaoNivel solucao;
+
+    if (modelo.tipo(modelo.tileCaminhado) != 0)
+    {
+        cerr << "Solver: o tile caminhado (" << modelo.tileCaminhado << ") não pode ser bloqueado, perigoso ou final\n";
+        return solucao;
+    }
+
+    const int nCelulas = modelo.linhas * modelo.colunas;
+    const int nEstados = 2 * nCelulas; // estado = celula + nCelulas * moeda
+
+    vector<atomic<uint64_t>> visitados((nEstados + 63) / 64);
+    for (auto &palavra : visitados)
+        palavra.store(0, memory_order_relaxed);
+    vector<int> pai(nEstados, -1);
+    vector<unsigned char> movimentoPai(nEstados, 0);
+
+    auto marcar = [&visitados](int estado) {
+        uint64_t bit = 1ull << (estado & 63);
+        return (visitados[estado >> 6].fetch_or(bit, memory_order_relaxed) & bit) == 0;
+    };
+
+    int inicio = (modelo.linhaInicial - 1) * modelo.colunas + (modelo.colunaInicial - 1);
+    marcar(inicio);
+
+    atomic<int> estadoFinal(-1);
+    vector<int> fronteira(1, inicio);
+    mutex travaProxima;
+
+    auto expandir = [&](int ini, int fim, vector<int> &saida) {
+        for (int k = ini; k < fim; k++)
+        {
+            int estado = fronteira[k];
+            int celulaAtual = estado % nCelulas;
+            for (int m = 0; m < NUM_MOVIMENTOS; m++)
+            {
+                int linha = celulaAtual / modelo.colunas + 1;
+                int coluna = celulaAtual % modelo.colunas + 1;
+                bool moeda = estado >= nCelulas;
+
+                // Cópia descartável da célula: o rastro não interfere nas regras (ver acima)
+                unsigned char rascunho;
+                auto celula = [&modelo, &rascunho](int i, int j) -> unsigned char & {
+                    rascunho = modelo.celulas[i * modelo.colunas + j];
+                    return rascunho;
+                };
+
+                int eventos = aplicarRegrasMovimento(modelo, celula, linha, coluna, moeda,
+                                                     MOVIMENTOS[m][0], MOVIMENTOS[m][1]);
+                int proximo = (linha - 1) * modelo.colunas + (coluna - 1) + (moeda ? nCelulas : 0);
+
+                if ((eventos & EVENTO_MORTE) || proximo == estado || !marcar(proximo))
+                    continue;
+
+                pai[proximo] = estado;
+                movimentoPai[proximo] = (unsigned char)m;
+                if (eventos & EVENTO_FINAL)
+                {
+                    int esperado = -1;
+                    estadoFinal.compare_exchange_strong(esperado, proximo);
+                }
+                saida.push_back(proximo);
+            }
+        }
+    };
+
+    while (!fronteira.empty() && estadoFinal.load() < 0)
+    {
+        vector<int> proxima;
+        if (fronteira.size() < LIMIAR_FRONTEIRA_PARALELA)
+        {
+            expandir(0, (int)fronteira.size(), proxima);
+        }
+        else
+        {
+            pool.paraCada((int)fronteira.size(), [&](int ini, int fim) {
+                vector<int> local;
+                expandir(ini, fim, local);
+                lock_guard<mutex> trava(travaProxima);
+                proxima.insert(proxima.end(), local.begin(), local.end());
+            });
+        }
+        fronteira.swap(proxima);
+    }
+
+    int estado = estadoFinal.load();
+    if (estado < 0)
+        return solucao;
+
+    for (; estado != inicio; estado = pai[estado])
+        solucao.movimentos.push_back(LETRAS_MOVIMENTO[movimentoPai[estado]]);
+    solucao.movimentos = string(solucao.movimentos.rbegin(), solucao.movimentos.rend());
+    solucao.passos = (int)solucao.movimentos.size();
+    solucao.resolvido = true;
+    return solucao;
+}
+
+// Modo de linha de comando: verifica vários níveis em paralelo e mostra o par de cada um
+void verificarNiveis(const vector<string> &caminhos)
+{
+    vector<ModeloMapa> modelos;
+    if (caminhos.empty())
+    {
+        modelos.push_back(modeloMapa);
+    }
+    else
+    {
+        for (const string &caminho : caminhos)
+        {
+            carregarMapaTxt(caminho);
+            modelos.push_back(criarModeloDoMapaAtual());
+        }
+    }
+
+    vector<SolucaoNivel> solucoes(modelos.size());
+    auto inicio = chrono::steady_clock::now();
+    poolGlobal().paraCada((int)modelos.size(), [&](int ini, int fim) {
+        for (int i = ini; i < fim; i++)
+            solucoes[i] = resolverNivel(modelos[i], poolGlobal());
+    });
+    double segundos = chrono::duration<double>(chrono::steady_clock::now() - inicio).count();
+
+    int resolvidos = 0;
+    for (size_t i = 0; i < solucoes.size(); i++)
+    {
+        string nome = caminhos.empty() ? string("(mapa atual)") : caminhos[i];
+        if (solucoes[i].resolvido)
+        {
+            resolvidos++;
+            cout << nome << ": par " << solucoes[i].passos << " (" << solucoes[i].movimentos << ")\n";
+        }
+        else
+        {
+            cout << nome << ": sem solução\n";
+        }
+    }
+    cout << resolvidos << "/" << solucoes.size() << " níveis com solução em " << segundos << " s\n";
+}
+
+struct Sprite
+{
+    GLuint VAO;
+    int textura = -1; // handle no cache de texturas, resolvido com texturaGL no desenho
+    vec3 position;
+    vec3 dimensions; // tamanho do frame
+
+    bool isAnimated;
+    float ds, dt;
+    int iAnimation, iFrame;
+	int nAnimations, nFrames;
+    bool isAlive = true;
+    bool isCollect = false;
+
+    int clipID = -1;         // clip em Animacoes.txt (-1: sem animação, usa offsetTex)
+    float tempoInicio = 0.0; // instante (uniform "tempo") em que o clip começou
+    int opacidade = -1;      // OPACIDADE_*, calculada quando a textura chega
+};
+
+Sprite principal;
+Sprite coin;
+
+// ================================
+// Rewind: anel de snapshots com deltas e keyframes
+// ================================
+// Um snapshot por tick guarda só o estado do personagem e as células do mapa alteradas desde o
+// snapshot anterior. A cada intervaloKeyframe ticks (ou quando um tick altera muitas células)
+// o mapa inteiro é copiado para um slot de keyframe. Voltar a um tick = copiar o keyframe
+// anterior e reaplicar no máximo intervaloKeyframe deltas. Todos os buffers são alocados uma
+// vez; quando enchem, o intervalo mais antigo (de keyframe a keyframe) é descartado.
+//
+// Os keyframes têm um orçamento fixo de bytes, então a memória não cresce com o mapa: mapas
+// pequenos ganham até MAX_KEYFRAMES slots a cada INTERVALO_KEYFRAME ticks; mapas grandes ganham
+// menos slots (no mínimo 2) e um intervalo maior entre eles. O preço é um rewind mais lento
+// (mais deltas para reaplicar) e, como o anel de deltas também é fixo, um histórico mais curto
+// quando muitas células mudam entre dois keyframes.
+
+const double TICKS_POR_SEGUNDO = 30.0;
+const int CAPACIDADE_SNAPSHOTS = 30 * 60 * 5; // 5 minutos de histórico
+const int INTERVALO_KEYFRAME = 256;           // menor intervalo, usado quando o orçamento sobra
+const int MAX_KEYFRAMES = CAPACIDADE_SNAPSHOTS / INTERVALO_KEYFRAME + 4;
+const size_t ORCAMENTO_KEYFRAMES = 1024 * 1024; // bytes para todos os slots de keyframe
+const int CAPACIDADE_DELTAS = 16384;
+const double SEGUNDOS_REWIND = 5.0; // quanto volta a cada toque no backspace
+
+struct EstadoJogador
+{
+    int linha = 1, coluna = 1;
+    bool moedaColetada = false;
+    int iAnimation = 0;
+    uint64_t hash = 0;
+};
+
+struct DeltaCelula
+{
+    int indice;
+    unsigned char valor; // valor novo
+};
+
+struct Snapshot
+{
+    uint32_t tick;
+    EstadoJogador jogador;
+    uint64_t inicioDelta; // posição (monotônica) do primeiro delta deste snapshot
+    uint32_t nDeltas;
+    int64_t keyframe;     // serial do keyframe guardado neste snapshot, ou -1
+    uint64_t posKeyframe; // posição do snapshot com o keyframe de referência
+};
+
+struct HistoricoRewind
+{
+    int nCelulas = 0;
+    vector<Snapshot> snapshots; // anel; válidos em [primeiro, fim)
+    uint64_t primeiro = 0, fim = 0;
+    vector<DeltaCelula> deltas; // anel; válidos em [primeiroDelta, fimDelta)
+    uint64_t primeiroDelta = 0, fimDelta = 0;
+    int numKeyframes = 0;     // slots que cabem em ORCAMENTO_KEYFRAMES
+    int intervaloKeyframe = 0; // ticks entre keyframes, para os slots cobrirem o histórico
+    vector<unsigned char> keyframes; // numKeyframes * nCelulas
+    int64_t proximoKeyframe = 0;
+    vector<AlteracaoCelula> pendentes; // alterações desde o último snapshot
+
+    Snapshot &em(uint64_t posicao) { return snapshots[posicao % CAPACIDADE_SNAPSHOTS]; }
+};
+
+HistoricoRewind historico;
+uint32_t tickAtual = 0;
+double proximoTick = 0.0; // glfwGetTime() em que o próximo snapshot é gravado
+
+void criarHistorico(HistoricoRewind &h, int nCelulas)
+{
+    h.nCelulas = nCelulas;
+    h.snapshots.assign(CAPACIDADE_SNAPSHOTS, Snapshot());
+    h.deltas.assign(CAPACIDADE_DELTAS, DeltaCelula());
+    h.numKeyframes = (int)glm::clamp(ORCAMENTO_KEYFRAMES / (size_t)std::max(nCelulas, 1), (size_t)2, (size_t)MAX_KEYFRAMES);
+    h.intervaloKeyframe = std::max(INTERVALO_KEYFRAME, (CAPACIDADE_SNAPSHOTS + h.numKeyframes - 2) / (h.numKeyframes - 1));
+    h.keyframes.assign((size_t)h.numKeyframes * nCelulas, 0);
+    h.primeiro = h.fim = 0;
+    h.primeiroDelta = h.fimDelta = 0;
+    h.proximoKeyframe = 0;
+    h.pendentes.clear();
+}
+
+// Descarta o intervalo mais antigo, até o próximo keyframe (o primeiro snapshot válido sempre é um keyframe)
+void descartarIntervaloMaisAntigo(HistoricoRewind &h)
+{
+    h.primeiro++;
+    while (h.primeiro < h.fim && h.em(h.primeiro).keyframe < 0)
+        h.primeiro++;
+    h.primeiroDelta = h.primeiro < h.fim ? h.em(h.primeiro).inicioDelta : h.fimDelta;
+}
+
+// copiarCelulas(destino) escreve o mapa atual (nCelulas bytes) em destino; só é chamada quando o
+// snapshot vira keyframe, então um tick comum custa só as células alteradas
+template <typename CopiarCelulas>
+void gravarSnapshot(HistoricoRewind &h, uint32_t tick, const EstadoJogador &jogador, CopiarCelulas copiarCelulas)
+{
+    uint64_t posicao = h.fim;
+    bool keyframe = h.fim == h.primeiro
+                 || (posicao - h.em(h.fim - 1).posKeyframe) >= (uint64_t)h.intervaloKeyframe
+                 || h.pendentes.size() > (size_t)CAPACIDADE_DELTAS / 4;
+
+    // Abre espaço no anel de snapshots, nos deltas e nos slots de keyframe
+    size_t deltasNecessarios = keyframe ? 0 : h.pendentes.size();
+    while (h.fim > h.primeiro && (h.fim - h.primeiro >= (uint64_t)CAPACIDADE_SNAPSHOTS
+                               || h.fimDelta + deltasNecessarios - h.primeiroDelta > (uint64_t)CAPACIDADE_DELTAS
+                               || (keyframe && h.proximoKeyframe - h.em(h.primeiro).keyframe >= h.numKeyframes)))
+    {
+        descartarIntervaloMaisAntigo(h);
+        // Se o descarte eliminou tudo, este snapshot precisa ser um keyframe
+        if (h.fim == h.primeiro && !keyframe)
+        {
+            keyframe = true;
+            deltasNecessarios = 0;
+        }
+    }
+    if (h.fim == h.primeiro)
+        h.primeiro = h.fim = posicao;
+
+    Snapshot &s = h.em(posicao);
+    s.tick = tick;
+    s.jogador = jogador;
+    s.inicioDelta = h.fimDelta;
+    s.nDeltas = 0;
+    s.keyframe = -1;
+    s.posKeyframe = posicao;
+
+    if (keyframe)
+    {
+        s.keyframe = h.proximoKeyframe++;
+        copiarCelulas(&h.keyframes[(size_t)(s.keyframe % h.numKeyframes) * h.nCelulas]);
+    }
+    else
+    {
+        s.posKeyframe = h.em(posicao - 1).posKeyframe;
+        for (const AlteracaoCelula &alteracao : h.pendentes)
+            h.deltas[h.fimDelta++ % CAPACIDADE_DELTAS] = {alteracao.indice, (unsigned char)alteracao.novo};
+        s.nDeltas = (uint32_t)h.pendentes.size();
+    }
+
+    h.pendentes.clear();
+    h.fim = posicao + 1;
+}
+
+uint32_t tickMaisAntigo(HistoricoRewind &h) { return h.em(h.primeiro).tick; }
+
+// Reconstrói o estado do tick pedido (limitado ao intervalo guardado) e descarta o "futuro".
+// Devolve false se o histórico estiver vazio.
+bool voltarParaTick(HistoricoRewind &h, uint32_t tick, unsigned char *celulas, EstadoJogador &jogador, uint32_t &tickRestaurado)
+{
+    if (h.fim == h.primeiro)
+        return false;
+
+    uint32_t primeiroTick = h.em(h.primeiro).tick;
+    uint32_t ultimoTick = h.em(h.fim - 1).tick;
+    tick = glm::clamp(tick, primeiroTick, ultimoTick);
+
+    uint64_t posicao = h.primeiro + (tick - primeiroTick);
+    const Snapshot &alvo = h.em(posicao);
+    const Snapshot &base = h.em(alvo.posKeyframe);
+
+    memcpy(celulas, &h.keyframes[(size_t)(base.keyframe % h.numKeyframes) * h.nCelulas], h.nCelulas);
+    for (uint64_t d = base.inicioDelta; d < alvo.inicioDelta + alvo.nDeltas; d++)
+    {
+        const DeltaCelula &delta = h.deltas[d % CAPACIDADE_DELTAS];
+        celulas[delta.indice] = delta.valor;
+    }
+
+    jogador = alvo.jogador;
+    tickRestaurado = alvo.tick;
+
+    h.fim = posicao + 1;
+    h.fimDelta = alvo.inicioDelta + alvo.nDeltas;
+    h.pendentes.clear();
+    return true;
+}
+
+EstadoJogador capturarEstadoJogador()
+{
+    EstadoJogador estado;
+    estado.linha = selectedTileMapLine;
+    estado.coluna = selectedTileMapColumn;
+    estado.moedaColetada = coin.isCollect;
+    estado.iAnimation = principal.iAnimation;
+    estado.hash = hashEstado;
+    return estado;
+}
+
+void gravarSnapshotDoJogo()
+{
+    gravarSnapshot(historico, tickAtual, capturarEstadoJogador(), [](unsigned char *celulas) {
+        for (int i = 0; i < TILEMAP_HEIGHT; i++)
+            for (int j = 0; j < TILEMAP_WIDTH; j++)
+                celulas[i * TILEMAP_WIDTH + j] = (unsigned char)map[i][j];
+    });
+}
+
+// Um snapshot por tick vencido. Chamada a cada volta do loop e antes de qualquer entrada mudar o estado:
+// o loop pode dormir vários ticks esperando eventos, e a tecla não pode cair em um tick anterior a ela.
+// Depois de travamentos longos não tenta "recuperar" os ticks.
+void gravarTicksVencidos()
+{
+    if (glfwGetTime() - proximoTick > 1.0)
+        proximoTick = glfwGetTime();
+    while (glfwGetTime() >= proximoTick)
+    {
+        tickAtual++;
+        gravarSnapshotDoJogo();
+        proximoTick += 1.0 / TICKS_POR_SEGUNDO;
+    }
+}
+
+void voltarNoTempo(double segundos)
+{
+    uint32_t ticks = (uint32_t)(segundos * TICKS_POR_SEGUNDO);
+    uint32_t alvo = tickAtual > ticks ? tickAtual - ticks : 0;
+
+    vector<unsigned char> celulas(TILEMAP_HEIGHT * TILEMAP_WIDTH);
+    EstadoJogador estado;
+    if (!voltarParaTick(historico, alvo, celulas.data(), estado, tickAtual))
+        return;
+
+    for (int i = 0; i < TILEMAP_HEIGHT; i++)
+        for (int j = 0; j < TILEMAP_WIDTH; j++)
+            map[i][j] = celulas[i * TILEMAP_WIDTH + j];
+    selectedTileMapLine = estado.linha;
+    selectedTileMapColumn = estado.coluna;
+    coin.isCollect = estado.moedaColetada;
+    principal.iAnimation = estado.iAnimation;
+    hashEstado = estado.hash;
+
+    assert(hashEstado == calcularHashCompleto(zobrist, [](int i, int j) { return map[i][j]; },
+                                              TILEMAP_HEIGHT, TILEMAP_WIDTH, selectedTileMapLine,
+                                              selectedTileMapColumn, coin.isCollect));
+    std::cout << "Voltou para o tick " << tickAtual << std::endl;
+}
+
+struct Tile
+{
+    GLuint VAO;
+    int textura = -1; // handle do tileset no cache de texturas
+    int iTile;    // indice dele no tileset
+    vec3 position;
+    vec3 dimensions; // tamanho do losango 2:1
+    float ds, dt;
+    int iAnimation, iFrame;
+    int nAnimations, nFrames;
+    int opacidade = -1; // OPACIDADE_*, calculada quando a textura chega
+};
+
+// ================================
+// Cache de estado da OpenGL
+// ================================
+// Espelho do estado que o jogo muda: programa, VAO, buffers, texturas por unidade, enable/disable,
+// blend, depth e os valores de cada uniform. As funções abaixo só chamam a OpenGL quando o valor
+// pedido é diferente do espelhado, e as locations de uniform ficam em cache por programa. Todo o
+// código do jogo passa por aqui em vez de chamar glBind*/glUseProgram/glUniform* direto; uma
+// chamada direta deixaria o espelho errado.
+
+const int MAX_UNIDADES_TEXTURA = 16;
+const int NUM_ALVOS_TEXTURA = 3; // GL_TEXTURE_2D, GL_TEXTURE_BUFFER, GL_TEXTURE_2D_ARRAY
+const size_t MAX_BYTES_UNIFORM = 64; // mat4
+
+struct ValorUniform
+{
+    size_t tamanho = 0; // 0 enquanto o valor não é conhecido
+    unsigned char bytes[MAX_BYTES_UNIFORM];
+};
+
+struct ProgramaEmCache
+{
+    unordered_map<string, GLint> locations;
+    unordered_map<GLint, ValorUniform> valores;
+};
+
+// Começa com o estado inicial de um contexto novo
+struct EstadoGL
+{
+    GLuint programa = 0;
+    GLuint vao = 0;
+    GLuint framebuffer = 0;        // GL_DRAW_FRAMEBUFFER
+    GLuint framebufferLeitura = 0; // GL_READ_FRAMEBUFFER
+    GLuint renderbuffer = 0;
+    GLint viewport[4] = {-1, -1, -1, -1}; // a janela define o primeiro
+    int unidadeAtiva = 0;
+    GLuint texturas[MAX_UNIDADES_TEXTURA][NUM_ALVOS_TEXTURA] = {};
+    unordered_map<GLenum, GLuint> buffers; // GL_ELEMENT_ARRAY_BUFFER fica de fora: faz parte do VAO
+    unordered_map<GLenum, bool> habilitado;
+    GLenum blend[4] = {GL_ONE, GL_ZERO, GL_ONE, GL_ZERO}; // origem/destino da cor e do alfa
+    GLenum depthFunc = GL_LESS;
+    bool depthMask = true;
+    unordered_map<GLuint, ProgramaEmCache> programas;
+};
+
+EstadoGL estadoGL;
+
+int indiceAlvoTextura(GLenum alvo)
+{
+    if (alvo == GL_TEXTURE_2D)
+        return 0;
+    if (alvo == GL_TEXTURE_BUFFER)
+        return 1;
+    if (alvo == GL_TEXTURE_2D_ARRAY)
+        return 2;
+    return -1;
+}
+
+void usarPrograma(GLuint programa)
+{
+    if (estadoGL.programa == programa)
+        return;
+    glUseProgram(programa);
+    estadoGL.programa = programa;
+}
+
+void vincularVAO(GLuint vao)
+{
+    if (estadoGL.vao == vao)
+        return;
+    glBindVertexArray(vao);
+    estadoGL.vao = vao;
+}
+
+void vincularBuffer(GLenum alvo, GLuint buffer)
+{
+    if (alvo == GL_ELEMENT_ARRAY_BUFFER)
+    {
+        glBindBuffer(alvo, buffer);
+        return;
+    }
+    auto it = estadoGL.buffers.find(alvo);
+    if (it != estadoGL.buffers.end() && it->second == buffer)
+        return;
+    glBindBuffer(alvo, buffer);
+    estadoGL.buffers[alvo] = buffer;
+}
+
+void ativarUnidadeTextura(int unidade)
+{
+    if (estadoGL.unidadeAtiva == unidade)
+        return;
+    glActiveTexture(GL_TEXTURE0 + unidade);
+    estadoGL.unidadeAtiva = unidade;
+}
+
+// Também usado antes de glTexImage2D/glTexParameteri: deixa a unidade ativa e a textura vinculadas
+void vincularTextura(int unidade, GLenum alvo, GLuint textura)
+{
+    int indice = indiceAlvoTextura(alvo);
+    if (indice >= 0 && unidade < MAX_UNIDADES_TEXTURA && estadoGL.texturas[unidade][indice] == textura)
+    {
+        ativarUnidadeTextura(unidade);
+        return;
+    }
+    ativarUnidadeTextura(unidade);
+    glBindTexture(alvo, textura);
+    if (indice >= 0 && unidade < MAX_UNIDADES_TEXTURA)
+        estadoGL.texturas[unidade][indice] = textura;
+}
+
+// Uma textura apagada deixa de estar vinculada em todas as unidades
+void apagarTextura(GLuint textura)
+{
+    glDeleteTextures(1, &textura);
+    for (auto &unidade : estadoGL.texturas)
+        for (GLuint &vinculada : unidade)
+            if (vinculada == textura)
+                vinculada = 0;
+}
+
+void habilitarGL(GLenum cap, bool ligado)
+{
+    auto it = estadoGL.habilitado.find(cap);
+    if (it != estadoGL.habilitado.end() ? it->second == ligado : !ligado)
+        return;
+    if (ligado)
+        glEnable(cap);
+    else
+        glDisable(cap);
+    estadoGL.habilitado[cap] = ligado;
+}
+
+void funcaoBlendSeparada(GLenum origemCor, GLenum destinoCor, GLenum origemAlfa, GLenum destinoAlfa)
+{
+    GLenum *b = estadoGL.blend;
+    if (b[0] == origemCor && b[1] == destinoCor && b[2] == origemAlfa && b[3] == destinoAlfa)
+        return;
+    if (origemCor == origemAlfa && destinoCor == destinoAlfa)
+        glBlendFunc(origemCor, destinoCor);
+    else
+        glBlendFuncSeparate(origemCor, destinoCor, origemAlfa, destinoAlfa);
+    b[0] = origemCor;
+    b[1] = destinoCor;
+    b[2] = origemAlfa;
+    b[3] = destinoAlfa;
+}
+
+void funcaoBlend(GLenum origem, GLenum destino)
+{
+    funcaoBlendSeparada(origem, destino, origem, destino);
+}
+
+// Vincula para desenho e leitura
+void vincularFramebuffer(GLuint fbo)
+{
+    if (estadoGL.framebuffer == fbo && estadoGL.framebufferLeitura == fbo)
+        return;
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    estadoGL.framebuffer = estadoGL.framebufferLeitura = fbo;
+}
+
+void vincularFramebufferLeitura(GLuint fbo)
+{
+    if (estadoGL.framebufferLeitura == fbo)
+        return;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+    estadoGL.framebufferLeitura = fbo;
+}
+
+void vincularRenderbuffer(GLuint rbo)
+{
+    if (estadoGL.renderbuffer == rbo)
+        return;
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    estadoGL.renderbuffer = rbo;
+}
+
+void definirViewport(GLint x, GLint y, GLsizei largura, GLsizei altura)
+{
+    GLint *v = estadoGL.viewport;
+    if (v[0] == x && v[1] == y && v[2] == largura && v[3] == altura)
+        return;
+    glViewport(x, y, largura, altura);
+    v[0] = x;
+    v[1] = y;
+    v[2] = largura;
+    v[3] = altura;
+}
+
+void funcaoDepth(GLenum funcao)
+{
+    if (estadoGL.depthFunc == funcao)
+        return;
+    glDepthFunc(funcao);
+    estadoGL.depthFunc = funcao;
+}
+
+void mascaraDepth(bool escrever)
+{
+    if (estadoGL.depthMask == escrever)
+        return;
+    glDepthMask(escrever ? GL_TRUE : GL_FALSE);
+    estadoGL.depthMask = escrever;
+}
+
+GLint localUniform(GLuint programa, const char *nome)
+{
+    ProgramaEmCache &p = estadoGL.programas[programa];
+    auto it = p.locations.find(nome);
+    if (it != p.locations.end())
+        return it->second;
+    GLint location = glGetUniformLocation(programa, nome);
+    p.locations[nome] = location;
+    return location;
+}
+
+// Vincula o programa e devolve a location se o valor for diferente do último enviado (-1 se não precisa enviar)
+GLint prepararUniform(GLuint programa, const char *nome, const void *dados, size_t tamanho)
+{
+    GLint location = localUniform(programa, nome);
+    if (location < 0)
+        return -1;
+    ValorUniform &valor = estadoGL.programas[programa].valores[location];
+    if (valor.tamanho == tamanho && memcmp(valor.bytes, dados, tamanho) == 0)
+        return -1;
+    valor.tamanho = tamanho;
+    memcpy(valor.bytes, dados, tamanho);
+    usarPrograma(programa);
+    return location;
+}
+
+void uniform1i(GLuint programa, const char *nome, GLint v)
+{
+    GLint location = prepararUniform(programa, nome, &v, sizeof(v));
+    if (location >= 0)
+        glUniform1i(location, v);
+}
+
+void uniform1f(GLuint programa, const char *nome, GLfloat v)
+{
+    GLint location = prepararUniform(programa, nome, &v, sizeof(v));
+    if (location >= 0)
+        glUniform1f(location, v);
+}
+
+void uniform2f(GLuint programa, const char *nome, GLfloat v0, GLfloat v1)
+{
+    GLfloat v[2] = {v0, v1};
+    GLint location = prepararUniform(programa, nome, v, sizeof(v));
+    if (location >= 0)
+        glUniform2f(location, v0, v1);
+}
+
+void uniform4f(GLuint programa, const char *nome, GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+{
+    GLfloat v[4] = {v0, v1, v2, v3};
+    GLint location = prepararUniform(programa, nome, v, sizeof(v));
+    if (location >= 0)
+        glUniform4f(location, v0, v1, v2, v3);
+}
+
+void uniform4fv(GLuint programa, const char *nome, const GLfloat *v)
+{
+    GLint location = prepararUniform(programa, nome, v, 4 * sizeof(GLfloat));
+    if (location >= 0)
+        glUniform4fv(location, 1, v);
+}
+
+void uniform1fv(GLuint programa, const char *nome, GLsizei n, const GLfloat *v)
+{
+    assert(n * sizeof(GLfloat) <= MAX_BYTES_UNIFORM);
+    GLint location = prepararUniform(programa, nome, v, n * sizeof(GLfloat));
+    if (location >= 0)
+        glUniform1fv(location, n, v);
+}
+
+void uniformMatrix4fv(GLuint programa, const char *nome, const GLfloat *v)
+{
+    GLint location = prepararUniform(programa, nome, v, 16 * sizeof(GLfloat));
+    if (location >= 0)
+        glUniformMatrix4fv(location, 1, GL_FALSE, v);
+}
+
+// ================================
+// Animações descritas em dados (Animacoes.txt)
+// ================================
+// Cada clip diz de qual folha de sprites ele vem, quantos frames por linha e quantas linhas a
+// folha tem, em qual linha o clip está, quantos frames usa, a taxa e o modo de repetição. As
+// coordenadas de textura de todos os frames são pré-calculadas em uma tabela enviada uma única
+// vez para a GPU; por desenho, o sprite só envia o id do clip e o instante em que ele começou,
+// e o vertex shader escolhe o frame a partir do uniform "tempo".
+
+const int ANIMACAO_LOOP = 0;
+const int ANIMACAO_UMA_VEZ = 1;
+const int ANIMACAO_VAI_E_VOLTA = 2;
+
+struct ClipAnimacao
+{
+    string nome;
+    string folha;       // arquivo em assets/sprites
+    int framesPorLinha; // colunas da folha
+    int nLinhas;        // linhas da folha
+    int linha;          // linha do clip (mesma convenção de iAnimation)
+    int nFrames;
+    float fps;
+    int modo;
+    int primeiroFrame;  // posição na tabela de UVs
+};
+
+vector<ClipAnimacao> clips;
+vector<int> clipsDirecao; // clip do principal para cada iAnimation
+vector<vec2> tabelaUV; // deslocamento de textura de cada frame de cada clip
+GLuint tboClips = 0, tboFrames = 0;
+GLuint texClips = 0, texFrames = 0;
+
+int registrarClip(ClipAnimacao clip)
+{
+    clip.primeiroFrame = (int)tabelaUV.size();
+    float ds = 1.0f / clip.framesPorLinha;
+    float dt = 1.0f / clip.nLinhas;
+    for (int f = 0; f < clip.nFrames; f++)
+        tabelaUV.push_back(vec2((f % clip.framesPorLinha) * ds, clip.linha * dt));
+    clips.push_back(clip);
+    return (int)clips.size() - 1;
+}
+
+int buscarClip(const string &nome)
+{
+    for (size_t i = 0; i < clips.size(); i++)
+        if (clips[i].nome == nome)
+            return (int)i;
+    return -1;
+}
+
+void carregarAnimacoesTxt(const string &path)
+{
+    PERFIL_ZONA("carregarAnimacoesTxt");
+    VisaoAsset asset;
+    if (!abrirAsset(path, asset))
+    {
+        cerr << "Erro ao abrir o arquivo de animações: " << path << "\n";
+        exit(1);
+    }
+    istringstream file(string((const char *)asset.dados, asset.tamanho));
+
+    ClipAnimacao clip;
+    string modo;
+    while (file >> clip.nome >> clip.folha >> clip.framesPorLinha >> clip.nLinhas >> clip.linha >> clip.nFrames >> clip.fps >> modo)
+    {
+        if (clip.framesPorLinha <= 0 || clip.nLinhas <= 0 || clip.nFrames <= 0)
+        {
+            cerr << "Clip de animação inválido: " << clip.nome << "\n";
+            exit(1);
+        }
+        clip.modo = modo == "uma-vez" ? ANIMACAO_UMA_VEZ : (modo == "vai-e-volta" ? ANIMACAO_VAI_E_VOLTA : ANIMACAO_LOOP);
+        registrarClip(clip);
+    }
+
+    cout << "Animações carregadas: " << clips.size() << " clips\n";
+}
+
+// Envia as tabelas de clips e de frames como texture buffers (unidades 1 e 2)
+void enviarTabelasAnimacao(GLuint shaderID)
+{
+    vector<vec4> dadosClips;
+    for (const ClipAnimacao &clip : clips)
+        dadosClips.push_back(vec4((float)clip.primeiroFrame, (float)clip.nFrames, clip.fps, (float)clip.modo));
+    vector<vec4> dadosFrames(tabelaUV.size());
+    for (const ClipAnimacao &clip : clips)
+        for (int f = 0; f < clip.nFrames; f++)
+        {
+            const vec2 &uv = tabelaUV[clip.primeiroFrame + f];
+            dadosFrames[clip.primeiroFrame + f] = vec4(uv.x, uv.y, 1.0f / clip.framesPorLinha, 1.0f / clip.nLinhas);
+        }
+
+    glGenBuffers(1, &tboClips);
+    vincularBuffer(GL_TEXTURE_BUFFER, tboClips);
+    glBufferData(GL_TEXTURE_BUFFER, dadosClips.size() * sizeof(vec4), dadosClips.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &tboFrames);
+    vincularBuffer(GL_TEXTURE_BUFFER, tboFrames);
+    glBufferData(GL_TEXTURE_BUFFER, dadosFrames.size() * sizeof(vec4), dadosFrames.data(), GL_STATIC_DRAW);
+    vincularBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenTextures(1, &texClips);
+    vincularTextura(1, GL_TEXTURE_BUFFER, texClips);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, tboClips);
+
+    glGenTextures(1, &texFrames);
+    vincularTextura(2, GL_TEXTURE_BUFFER, texFrames);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, tboFrames);
+
+    uniform1i(shaderID, "tabelaClips", 1);
+    uniform1i(shaderID, "tabelaFrames", 2);
+}
+
+// ================================
+// Opacidade das texturas
+// ================================
+// Quando os pixels de uma textura chegam, o canal alfa é copiado para a CPU e cada tile ou sprite que a
+// usa é classificado pela região que desenha: opaca (todo texel com alfa 255), recorte (só 0 ou 255,
+// resolvido pelo descarte do fragment shader) ou translúcida (algum alfa intermediário). Opacos e
+// recortes vão em um passo sem blending, da frente para trás, escrevendo profundidade, então o que fica
+// atrás deles é rejeitado pelo teste de profundidade; só os translúcidos passam pelo blending, depois,
+// de trás para frente e sem escrever profundidade. Um shader com discard perde o teste de profundidade
+// antecipado (early-Z) na maioria das GPUs, então os opacos usam uma variante do programa do jogo sem o
+// recorte (shaderOpaco); os uniforms que valem para o quadro todo vão para as duas variantes.
+
+const int OPACIDADE_DESCONHECIDA = -1; // textura ainda carregando (placeholder)
+const int OPACIDADE_OPACA = 0;
+const int OPACIDADE_RECORTE = 1;
+const int OPACIDADE_TRANSLUCIDA = 2;
+
+GLuint shaderOpaco = 0; // programa do jogo compilado com SEM_RECORTE
+
+struct AlfaTextura
+{
+    int largura = 0, altura = 0;
+    vector<unsigned char> alfa; // vazio: imagem sem canal alfa
+};
+
+unordered_map<GLuint, AlfaTextura> alfaTexturas;
+
+void registrarAlfaTextura(GLuint texID, const unsigned char *pixels, int largura, int altura, int canais)
+{
+    AlfaTextura &a = alfaTexturas[texID];
+    a.largura = largura;
+    a.altura = altura;
+    a.alfa.clear();
+    if (canais != 4)
+        return;
+    a.alfa.resize((size_t)largura * altura);
+    for (size_t t = 0; t < a.alfa.size(); t++)
+        a.alfa[t] = pixels[t * 4 + 3];
+}
+
+// Classifica os texels do retângulo [x0, x1) x [y0, y1) da textura, em frações do tamanho dela; com
+// losango, só os texels dentro do losango inscrito no retângulo (a geometria dos tiles)
+int classificarRegiao(GLuint texID, float x0, float y0, float x1, float y1, bool losango)
+{
+    auto it = alfaTexturas.find(texID);
+    if (it == alfaTexturas.end())
+        return OPACIDADE_DESCONHECIDA;
+    const AlfaTextura &a = it->second;
+    if (a.alfa.empty())
+        return OPACIDADE_OPACA;
+
+    int tx0 = (int)lround(x0 * a.largura), tx1 = (int)lround(x1 * a.largura);
+    int ty0 = (int)lround(y0 * a.altura), ty1 = (int)lround(y1 * a.altura);
+    float cx = (tx0 + tx1) / 2.0f, cy = (ty0 + ty1) / 2.0f;
+    float rx = std::max((tx1 - tx0) / 2.0f, 0.5f), ry = std::max((ty1 - ty0) / 2.0f, 0.5f);
+
+    int opacidade = OPACIDADE_OPACA;
+    for (int y = std::max(ty0, 0); y < std::min(ty1, a.altura); y++)
+    {
+        for (int x = std::max(tx0, 0); x < std::min(tx1, a.largura); x++)
+        {
+            if (losango && fabsf(x + 0.5f - cx) / rx + fabsf(y + 0.5f - cy) / ry > 1.0f)
+                continue;
+            unsigned char alfa = a.alfa[(size_t)y * a.largura + x];
+            if (alfa != 0 && alfa != 255)
+                return OPACIDADE_TRANSLUCIDA;
+            if (alfa == 0)
+                opacidade = OPACIDADE_RECORTE;
+        }
+    }
+    return opacidade;
+}
+
+// Opacos e recortes vão no passo sem blending; o que ainda não foi classificado vai com os translúcidos
+bool passoOpaco(int opacidade)
+{
+    return opacidade == OPACIDADE_OPACA || opacidade == OPACIDADE_RECORTE;
+}
+
+// Só a geometria sem nenhum texel transparente dispensa o descarte
+GLuint programaParaOpacidade(GLuint shaderID, int opacidade)
+{
+    return opacidade == OPACIDADE_OPACA && shaderOpaco != 0 ? shaderOpaco : shaderID;
+}
+
+int opacidadeTile(Tile &tile)
+{
+    if (tile.opacidade == OPACIDADE_DESCONHECIDA)
+        tile.opacidade = classificarRegiao(texturaGL(tile.textura), tile.iTile * tile.ds, 0.0f, (tile.iTile + 1) * tile.ds, 1.0f, true);
+    return tile.opacidade;
+}
+
+// Sprites animados podem mostrar qualquer frame da folha, então a folha inteira é classificada
+int opacidadeSprite(Sprite &sprite)
+{
+    if (sprite.opacidade == OPACIDADE_DESCONHECIDA)
+        sprite.opacidade = classificarRegiao(texturaGL(sprite.textura), 0.0f, 0.0f, 1.0f, 1.0f, false);
+    return sprite.opacidade;
+}
+
+// ================================
+// Carregamento assíncrono de texturas
+// ================================
+// A thread da OpenGL cria a textura com um placeholder 1x1 transparente e devolve o id na hora;
+// a decodificação (stb_image) roda no pool de threads. A cada quadro, processarTexturasProntas
+// envia os pixels já decodificados através de pixel buffer objects, então o primeiro quadro
+// aparece antes de os assets terminarem de carregar.
+
+struct TexturaDecodificada
+{
+    GLuint texID;
+    string caminho;
+    unsigned char *pixels; // nullptr se falhou
+    int largura, altura, canais;
+};
+
+mutex travaTexturasProntas;
+vector<TexturaDecodificada> texturasProntas;
+atomic<int> texturasPendentes(0);
+
+const int NUM_PBOS = 4;
+GLuint pbosUpload[NUM_PBOS] = {};
+int proximoPbo = 0;
+
+void configurarParametrosTextura()
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+GLuint carregarTexturaAssincrona(const string &caminho)
+{
+    GLuint texID;
+    glGenTextures(1, &texID);
+    vincularTextura(0, GL_TEXTURE_2D, texID);
+    configurarParametrosTextura();
+
+    const unsigned char placeholder[4] = {0, 0, 0, 0};
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+    vincularTextura(0, GL_TEXTURE_2D, 0);
+
+    texturasPendentes++;
+    poolGlobal().enfileirar([texID, caminho] {
+        PERFIL_ZONA("decodificarTextura");
+        TexturaDecodificada textura = {texID, caminho, nullptr, 0, 0, 0};
+        VisaoAsset asset;
+        if (abrirAsset(caminho, asset))
+            textura.pixels = stbi_load_from_memory(asset.dados, (int)asset.tamanho, &textura.largura, &textura.altura, &textura.canais, 0);
+        {
+            lock_guard<mutex> trava(travaTexturasProntas);
+            texturasProntas.push_back(textura);
+        }
+        glfwPostEmptyEvent(); // acorda o loop principal, que pode estar esperando eventos
+    });
+
+    return texID;
+}
+
+// Envia para a GPU as texturas decodificadas desde o último quadro, respeitando um orçamento de tempo
+void processarTexturasProntas(double orcamentoSegundos)
+{
+    PERFIL_ZONA("processarTexturasProntas");
+    if (texturasPendentes.load() == 0)
+        return;
+
+    if (pbosUpload[0] == 0)
+        glGenBuffers(NUM_PBOS, pbosUpload);
+
+    double inicio = glfwGetTime();
+    while (glfwGetTime() - inicio < orcamentoSegundos)
+    {
+        TexturaDecodificada textura;
+        {
+            lock_guard<mutex> trava(travaTexturasProntas);
+            if (texturasProntas.empty())
+                return;
+            textura = texturasProntas.back();
+            texturasProntas.pop_back();
+        }
+        texturasPendentes--;
+
+        if (!textura.pixels)
+        {
+            std::cout << "Failed to load texture: " << textura.caminho << std::endl;
+            registrarFalhaTextura(textura.texID);
+            continue;
+        }
+
+        GLenum formato = textura.canais == 3 ? GL_RGB : GL_RGBA; // jpg, bmp : png
+        size_t bytes = (size_t)textura.largura * textura.altura * (textura.canais == 3 ? 3 : 4);
+
+        // Buffer "órfão" a cada envio: o driver não precisa esperar o uso anterior do mesmo PBO
+        vincularBuffer(GL_PIXEL_UNPACK_BUFFER, pbosUpload[proximoPbo]);
+        proximoPbo = (proximoPbo + 1) % NUM_PBOS;
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+        void *destino = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        // Sem o mapeamento (driver sem memória para o PBO), envia direto da memória do cliente
+        const void *origem = textura.pixels;
+        if (destino)
+        {
+            memcpy(destino, textura.pixels, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            origem = (void *)0; // deslocamento dentro do PBO
+        }
+        else
+            vincularBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        vincularTextura(0, GL_TEXTURE_2D, textura.texID);
+        glTexImage2D(GL_TEXTURE_2D, 0, formato, textura.largura, textura.altura, 0, formato, GL_UNSIGNED_BYTE, origem);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        vincularTextura(0, GL_TEXTURE_2D, 0);
+        vincularBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        registrarAlfaTextura(textura.texID, textura.pixels, textura.largura, textura.altura, textura.canais);
+        stbi_image_free(textura.pixels);
+        registrarTamanhoTextura(textura.texID, bytes * 4 / 3);
+        invalidarCacheMapa(); // pode ser a textura de um tile que estava com o placeholder
+        marcarQuadroSujo();
+    }
+}
+
+// ================================
+// Pacote de texturas pré-processadas (texturas.pack)
+// ================================
+// Gerado offline com --empacotar-texturas: guarda os texels já decodificados e a cadeia de
+// mipmaps completa, mais um índice. Em tempo de execução o arquivo é mapeado em memória e os
+// níveis são enviados para a GPU direto das páginas mapeadas, sem PNG/JPEG nem glGenerateMipmap.
+//
+// Layout (little-endian):
+//   CabecalhoPacote
+//   EntradaPacote[nTexturas]
+//   dados: para cada textura, os níveis de mipmap em sequência (alinhados a 16 bytes)
+
+struct ArquivoMapeado
+{
+    const unsigned char *dados = nullptr;
+    size_t tamanho = 0;
+#ifdef _WIN32
+    HANDLE arquivo = INVALID_HANDLE_VALUE, mapeamento = nullptr;
+#endif
+};
+
+bool mapearArquivo(const string &caminho, ArquivoMapeado &arquivo)
+{
+#ifdef _WIN32
+    arquivo.arquivo = CreateFileA(caminho.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (arquivo.arquivo == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER tamanho;
+    GetFileSizeEx(arquivo.arquivo, &tamanho);
+    arquivo.tamanho = (size_t)tamanho.QuadPart;
+    arquivo.mapeamento = CreateFileMappingA(arquivo.arquivo, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (arquivo.mapeamento)
+        arquivo.dados = (const unsigned char *)MapViewOfFile(arquivo.mapeamento, FILE_MAP_READ, 0, 0, 0);
+    if (!arquivo.dados)
+    {
+        if (arquivo.mapeamento)
+            CloseHandle(arquivo.mapeamento);
+        CloseHandle(arquivo.arquivo);
+        arquivo = ArquivoMapeado();
+        return false;
+    }
+    return true;
+#else
+    int fd = open(caminho.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+    void *dados = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // o mapeamento continua válido sem o descritor
+    if (dados == MAP_FAILED)
+        return false;
+    arquivo.dados = (const unsigned char *)dados;
+    arquivo.tamanho = (size_t)info.st_size;
+    return true;
+#endif
+}
+
+void desmapearArquivo(ArquivoMapeado &arquivo)
+{
+    if (!arquivo.dados)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(arquivo.dados);
+    CloseHandle(arquivo.mapeamento);
+    CloseHandle(arquivo.arquivo);
+#else
+    munmap((void *)arquivo.dados, arquivo.tamanho);
+#endif
+    arquivo = ArquivoMapeado();
+}
+
+const char MAGIA_PACOTE_TEXTURAS[4] = {'P', 'G', 'T', 'X'};
+const uint32_t VERSAO_PACOTE_TEXTURAS = 2;
+
+struct CabecalhoPacote
+{
+    char magia[4];
+    uint32_t versao;
+    uint32_t nTexturas;
+    uint32_t reservado;
+};
+
+struct EntradaPacote
+{
+    char nome[112]; // caminho relativo a assets/, ex.: "sprites/coin.png"
+    uint32_t largura, altura;
+    uint32_t canais; // 3 ou 4
+    uint32_t nMips;
+    uint64_t offset; // início do nível 0
+    uint64_t tamanho; // todos os níveis
+    uint64_t tamanhoOrigem; // tamanho e data de modificação da imagem de origem, para detectar entradas antigas
+    int64_t dataOrigem;
+};
+
+ArquivoMapeado pacoteTexturas;
+unordered_map<string, const EntradaPacote *> indicePacoteTexturas;
+
+// "assets/sprites/coin.png" -> "sprites/coin.png"
+string nomeNoPacote(const string &caminho)
+{
+    string normalizado = filesystem::path(caminho).lexically_normal().generic_string();
+    size_t pos = normalizado.rfind("assets/");
+    return pos == string::npos ? normalizado : normalizado.substr(pos + 7);
+}
+
+size_t tamanhoNivelMip(uint32_t largura, uint32_t altura, uint32_t canais, uint32_t nivel)
+{
+    return (size_t)std::max(1u, largura >> nivel) * std::max(1u, altura >> nivel) * canais;
+}
+
+// Identificação da imagem de origem guardada no pacote; false se o arquivo não existe
+bool identificarOrigem(const string &caminho, uint64_t &tamanho, int64_t &data)
+{
+    std::error_code erro;
+    tamanho = filesystem::file_size(caminho, erro);
+    if (erro)
+        return false;
+    data = (int64_t)filesystem::last_write_time(caminho, erro).time_since_epoch().count();
+    return !erro;
+}
+
+// Motivo para descartar uma entrada do índice, ou nullptr se ela pode ser usada
+const char *problemaEntradaPacote(const EntradaPacote &entrada, size_t tamanhoArquivo)
+{
+    if (entrada.canais != 3 && entrada.canais != 4)
+        return "número de canais inválido";
+    if (entrada.largura == 0 || entrada.altura == 0)
+        return "dimensões inválidas";
+    uint32_t maximoMips = 1;
+    while ((std::max(entrada.largura, entrada.altura) >> maximoMips) > 0)
+        maximoMips++;
+    if (entrada.nMips == 0 || entrada.nMips > maximoMips)
+        return "número de níveis de mipmap inválido";
+    uint64_t cadeia = 0;
+    for (uint32_t m = 0; m < entrada.nMips; m++)
+        cadeia += tamanhoNivelMip(entrada.largura, entrada.altura, entrada.canais, m);
+    if (cadeia != entrada.tamanho)
+        return "tamanho dos dados não confere com as dimensões";
+    if (entrada.offset > tamanhoArquivo || entrada.tamanho > tamanhoArquivo - entrada.offset)
+        return "dados fora do arquivo";
+
+    // Imagem editada depois de gerar o pacote: vale a imagem solta. Sem o arquivo solto, vale o pacote.
+    uint64_t tamanho;
+    int64_t data;
+    string origem = resolverCaminho("assets/" + string(entrada.nome, strnlen(entrada.nome, sizeof(entrada.nome))));
+    if (identificarOrigem(origem, tamanho, data) && (tamanho != entrada.tamanhoOrigem || data != entrada.dataOrigem))
+        return "imagem de origem alterada; gere o pacote de novo com --empacotar-texturas";
+    return nullptr;
+}
+
+void abrirPacoteTexturas(const string &caminho)
+{
+    if (!mapearArquivo(caminho, pacoteTexturas))
+        return; // sem pacote: as texturas são decodificadas normalmente
+
+    const CabecalhoPacote *cabecalho = (const CabecalhoPacote *)pacoteTexturas.dados;
+    if (pacoteTexturas.tamanho < sizeof(CabecalhoPacote) || memcmp(cabecalho->magia, MAGIA_PACOTE_TEXTURAS, 4) != 0
+        || cabecalho->versao != VERSAO_PACOTE_TEXTURAS
+        || sizeof(CabecalhoPacote) + (size_t)cabecalho->nTexturas * sizeof(EntradaPacote) > pacoteTexturas.tamanho)
+    {
+        cerr << "Pacote de texturas inválido: " << caminho << "\n";
+        desmapearArquivo(pacoteTexturas);
+        return;
+    }
+
+    const EntradaPacote *entradas = (const EntradaPacote *)(pacoteTexturas.dados + sizeof(CabecalhoPacote));
+    for (uint32_t i = 0; i < cabecalho->nTexturas; i++)
+    {
+        string nome(entradas[i].nome, strnlen(entradas[i].nome, sizeof(entradas[i].nome)));
+        if (const char *problema = problemaEntradaPacote(entradas[i], pacoteTexturas.tamanho))
+            cerr << "Pacote de texturas: " << nome << " descartada (" << problema << ")\n";
+        else
+            indicePacoteTexturas[nome] = &entradas[i];
+    }
+    cout << "Pacote de texturas: " << indicePacoteTexturas.size() << " texturas em " << caminho << "\n";
+}
+
+// Cria a textura a partir do pacote, se ela estiver lá. Devolve 0 caso contrário.
+GLuint carregarTexturaDoPacote(const string &caminho, size_t &bytes)
+{
+    PERFIL_ZONA("carregarTexturaDoPacote");
+    auto it = indicePacoteTexturas.find(nomeNoPacote(caminho));
+    if (it == indicePacoteTexturas.end())
+        return 0;
+    const EntradaPacote &entrada = *it->second;
+
+    GLuint texID;
+    glGenTextures(1, &texID);
+    vincularTextura(0, GL_TEXTURE_2D, texID);
+    configurarParametrosTextura();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)entrada.nMips - 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    GLenum formato = entrada.canais == 3 ? GL_RGB : GL_RGBA;
+    const unsigned char *nivel = pacoteTexturas.dados + entrada.offset;
+    registrarAlfaTextura(texID, nivel, (int)entrada.largura, (int)entrada.altura, (int)entrada.canais);
+    for (uint32_t m = 0; m < entrada.nMips; m++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, m, formato, std::max(1u, entrada.largura >> m), std::max(1u, entrada.altura >> m),
+                     0, formato, GL_UNSIGNED_BYTE, nivel);
+        nivel += tamanhoNivelMip(entrada.largura, entrada.altura, entrada.canais, m);
+    }
+    vincularTextura(0, GL_TEXTURE_2D, 0);
+
+    bytes = (size_t)entrada.tamanho;
+    return texID;
+}
+
+// Reduz um nível à metade com média 2x2 (mesmo resultado esperado de glGenerateMipmap)
+vector<unsigned char> reduzirNivelMip(const unsigned char *origem, int largura, int altura, int canais)
+{
+    int novaLargura = std::max(1, largura / 2), novaAltura = std::max(1, altura / 2);
+    vector<unsigned char> destino((size_t)novaLargura * novaAltura * canais);
+    for (int y = 0; y < novaAltura; y++)
+        for (int x = 0; x < novaLargura; x++)
+            for (int c = 0; c < canais; c++)
+            {
+                int x0 = std::min(2 * x, largura - 1), x1 = std::min(2 * x + 1, largura - 1);
+                int y0 = std::min(2 * y, altura - 1), y1 = std::min(2 * y + 1, altura - 1);
+                int soma = origem[((size_t)y0 * largura + x0) * canais + c] + origem[((size_t)y0 * largura + x1) * canais + c]
+                         + origem[((size_t)y1 * largura + x0) * canais + c] + origem[((size_t)y1 * largura + x1) * canais + c];
+                destino[((size_t)y * novaLargura + x) * canais + c] = (unsigned char)((soma + 2) / 4);
+            }
+    return destino;
+}
+
+// Modo de linha de comando: decodifica as imagens, gera os mipmaps e grava o pacote
+int empacotarTexturas(const string &saida, vector<string> imagens)
+{
+    if (imagens.empty())
+    {
+        for (const auto &item : filesystem::recursive_directory_iterator(raizProjeto() + "/assets"))
+        {
+            string extensao = item.path().extension().string();
+            if (extensao == ".png" || extensao == ".jpg" || extensao == ".jpeg")
+                imagens.push_back(item.path().generic_string());
+        }
+    }
+
+    vector<EntradaPacote> entradas;
+    vector<vector<unsigned char>> dados;
+    uint64_t offset = sizeof(CabecalhoPacote) + imagens.size() * sizeof(EntradaPacote);
+
+    for (const string &imagem : imagens)
+    {
+        int largura, altura, canais;
+        unsigned char *pixels = stbi_load(imagem.c_str(), &largura, &altura, &canais, 0);
+        if (pixels && canais != 3 && canais != 4)
+        {
+            stbi_image_free(pixels);
+            pixels = stbi_load(imagem.c_str(), &largura, &altura, &canais, 4);
+            canais = 4;
+        }
+        if (!pixels)
+        {
+            cerr << "Falha ao ler " << imagem << ": " << stbi_failure_reason() << "\n";
+            return 1;
+        }
+
+        EntradaPacote entrada = {};
+        string nome = nomeNoPacote(imagem);
+        strncpy(entrada.nome, nome.c_str(), sizeof(entrada.nome) - 1);
+        entrada.largura = largura;
+        entrada.altura = altura;
+        entrada.canais = canais;
+        identificarOrigem(imagem, entrada.tamanhoOrigem, entrada.dataOrigem);
+
+        vector<unsigned char> cadeia(pixels, pixels + (size_t)largura * altura * canais);
+        stbi_image_free(pixels);
+        vector<unsigned char> nivel = cadeia;
+        int l = largura, a = altura;
+        entrada.nMips = 1;
+        while (l > 1 || a > 1)
+        {
+            nivel = reduzirNivelMip(nivel.data(), l, a, canais);
+            l = std::max(1, l / 2);
+            a = std::max(1, a / 2);
+            cadeia.insert(cadeia.end(), nivel.begin(), nivel.end());
+            entrada.nMips++;
+        }
+
+        offset = (offset + 15) & ~(uint64_t)15;
+        entrada.offset = offset;
+        entrada.tamanho = cadeia.size();
+        offset += cadeia.size();
+
+        entradas.push_back(entrada);
+        dados.push_back(std::move(cadeia));
+        cout << "  " << nome << " (" << largura << "x" << altura << ", " << entrada.nMips << " níveis)\n";
+    }
+
+    ofstream arquivo(saida, ios::binary);
+    if (!arquivo.is_open())
+    {
+        cerr << "Erro ao criar " << saida << "\n";
+        return 1;
+    }
+
+    CabecalhoPacote cabecalho = {};
+    memcpy(cabecalho.magia, MAGIA_PACOTE_TEXTURAS, 4);
+    cabecalho.versao = VERSAO_PACOTE_TEXTURAS;
+    cabecalho.nTexturas = (uint32_t)entradas.size();
+    arquivo.write((const char *)&cabecalho, sizeof(cabecalho));
+    arquivo.write((const char *)entradas.data(), entradas.size() * sizeof(EntradaPacote));
+    for (size_t i = 0; i < dados.size(); i++)
+    {
+        static const char zeros[16] = {};
+        arquivo.write(zeros, entradas[i].offset - (uint64_t)arquivo.tellp());
+        arquivo.write((const char *)dados[i].data(), dados[i].size());
+    }
+
+    cout << "Pacote gravado: " << saida << " (" << entradas.size() << " texturas, " << offset / 1024 << " KiB)\n";
+    return 0;
+}
+
+// ================================
+// Pacote único de assets (assets.bundle) com índice de hash perfeito
+// ================================
+// Os assets são pedidos por nome lógico, relativo à raiz do projeto (ex.: "assets/sprites/coin.png",
+// "src/ExemplosMoodle/M6_Material/Mapa.txt"). Se assets.bundle existir, ele é mapeado em memória
+// uma única vez e cada pedido devolve uma visão sem cópia para dentro do arquivo; o índice é um
+// hash perfeito mínimo (hash and displace), então a busca é uma conta e uma comparação. Sem o
+// pacote, os arquivos soltos são procurados a partir da raiz do projeto, independente do
+// diretório de trabalho.
+//
+// Layout: CabecalhoBundle, uint32_t sementes[nBaldes], EntradaBundle[nEntradas], nomes, dados
+
+const char MAGIA_BUNDLE[4] = {'P', 'G', 'A', 'B'};
+const uint32_t VERSAO_BUNDLE = 1;
+
+struct CabecalhoBundle
+{
+    char magia[4];
+    uint32_t versao;
+    uint32_t nEntradas;
+    uint32_t nBaldes;
+};
+
+struct EntradaBundle
+{
+    uint64_t hash;   // hashNome(nome, 0), para descartar rápido nomes que não estão no pacote
+    uint64_t offset; // dos dados, a partir do início do arquivo
+    uint64_t tamanho;
+    uint32_t offsetNome;
+    uint32_t tamanhoNome;
+};
+
+ArquivoMapeado bundleAssets;
+const CabecalhoBundle *cabecalhoBundle = nullptr;
+const uint32_t *sementesBundle = nullptr;
+const EntradaBundle *entradasBundle = nullptr;
+
+// FNV-1a seguido da finalização do splitmix64, com semente
+uint64_t hashNome(const char *nome, size_t tamanho, uint64_t semente)
+{
+    uint64_t h = 0xCBF29CE484222325ull ^ (semente * 0x9E3779B97F4A7C15ull);
+    for (size_t i = 0; i < tamanho; i++)
+        h = (h ^ (unsigned char)nome[i]) * 0x100000001B3ull;
+    return proximoSplitMix64(h);
+}
+
+// Raízes onde procurar arquivos soltos: a do CMake (se definida) e as usuais a partir de build/
+vector<string> raizesProjeto()
+{
+    vector<string> raizes;
+#ifdef PROJETO_DIR
+    raizes.push_back(PROJETO_DIR);
+#endif
+    raizes.push_back("..");
+    raizes.push_back(".");
+    return raizes;
+}
+
+string resolverCaminho(const string &nome)
+{
+    if (filesystem::exists(nome))
+        return nome;
+    for (const string &raiz : raizesProjeto())
+    {
+        string caminho = raiz + "/" + nome;
+        if (filesystem::exists(caminho))
+            return caminho;
+    }
+    return nome;
+}
+
+// Primeira raiz que contém a pasta assets (onde ficam os pacotes gerados)
+string raizProjeto()
+{
+    for (const string &raiz : raizesProjeto())
+        if (filesystem::exists(raiz + "/assets"))
+            return raiz;
+    return ".";
+}
+
+void abrirBundle(const string &caminho)
+{
+    if (!mapearArquivo(caminho, bundleAssets))
+        return;
+
+    const CabecalhoBundle *cabecalho = (const CabecalhoBundle *)bundleAssets.dados;
+    size_t tamanhoIndice = sizeof(CabecalhoBundle);
+    if (bundleAssets.tamanho >= sizeof(CabecalhoBundle))
+        tamanhoIndice += cabecalho->nBaldes * sizeof(uint32_t) + (size_t)cabecalho->nEntradas * sizeof(EntradaBundle);
+    if (bundleAssets.tamanho < sizeof(CabecalhoBundle) || memcmp(cabecalho->magia, MAGIA_BUNDLE, 4) != 0
+        || cabecalho->versao != VERSAO_BUNDLE || cabecalho->nBaldes == 0 || tamanhoIndice > bundleAssets.tamanho)
+    {
+        cerr << "Pacote de assets inválido: " << caminho << "\n";
+        desmapearArquivo(bundleAssets);
+        return;
+    }
+
+    // Nomes e dados de todas as entradas precisam estar dentro do arquivo: a busca e abrirAsset não conferem
+    const uint32_t *sementes = (const uint32_t *)(bundleAssets.dados + sizeof(CabecalhoBundle));
+    const EntradaBundle *entradas = (const EntradaBundle *)(sementes + cabecalho->nBaldes);
+    size_t tamanho = bundleAssets.tamanho;
+    for (uint32_t i = 0; i < cabecalho->nEntradas; i++)
+    {
+        const EntradaBundle &e = entradas[i];
+        if (e.offsetNome > tamanho || e.tamanhoNome > tamanho - e.offsetNome || e.offset > tamanho
+            || e.tamanho > tamanho - e.offset)
+        {
+            cerr << "Pacote de assets inválido (entrada " << i << " fora do arquivo): " << caminho << "\n";
+            desmapearArquivo(bundleAssets);
+            return;
+        }
+    }
+
+    cabecalhoBundle = cabecalho;
+    sementesBundle = sementes;
+    entradasBundle = entradas;
+    cout << "Pacote de assets: " << cabecalho->nEntradas << " arquivos em " << caminho << "\n";
+}
+
+const EntradaBundle *buscarNoBundle(const string &nome)
+{
+    if (!cabecalhoBundle || cabecalhoBundle->nEntradas == 0)
+        return nullptr;
+
+    uint64_t h = hashNome(nome.data(), nome.size(), 0);
+    uint32_t semente = sementesBundle[h % cabecalhoBundle->nBaldes];
+    const EntradaBundle &entrada = entradasBundle[hashNome(nome.data(), nome.size(), semente) % cabecalhoBundle->nEntradas];
+
+    if (entrada.hash != h || entrada.tamanhoNome != nome.size()
+        || memcmp(bundleAssets.dados + entrada.offsetNome, nome.data(), nome.size()) != 0)
+        return nullptr;
+    return &entrada;
+}
+
+bool abrirAsset(const string &nome, VisaoAsset &visao)
+{
+    string logico = filesystem::path(nome).lexically_normal().generic_string();
+    while (logico.compare(0, 3, "../") == 0)
+        logico = logico.substr(3);
+
+    if (const EntradaBundle *entrada = buscarNoBundle(logico))
+    {
+        visao.dados = bundleAssets.dados + entrada->offset;
+        visao.tamanho = (size_t)entrada->tamanho;
+        return true;
+    }
+
+    // Modo de desenvolvimento: arquivo solto
+    ifstream arquivo(resolverCaminho(nome), ios::binary);
+    if (!arquivo.is_open())
+        return false;
+    visao.armazenamento.assign(istreambuf_iterator<char>(arquivo), istreambuf_iterator<char>());
+    visao.dados = visao.armazenamento.data();
+    visao.tamanho = visao.armazenamento.size();
+    return true;
+}
+
+// Modo de linha de comando: junta todos os assets em um único arquivo com índice de hash perfeito
+int empacotarAssets(const string &saida)
+{
+    string raiz = raizProjeto() + "/";
+
+    vector<string> nomes;
+    for (const char *pasta : {"assets", "src/ExemplosMoodle/M6_Material"})
+    {
+        if (!filesystem::exists(raiz + pasta))
+            continue;
+        for (const auto &item : filesystem::recursive_directory_iterator(raiz + pasta))
+        {
+            string extensao = item.path().extension().string();
+            if (!item.is_regular_file() || extensao == ".pack" || extensao == ".bundle" || extensao == ".cpp" || extensao == ".md")
+                continue;
+            nomes.push_back(filesystem::relative(item.path(), raiz).lexically_normal().generic_string());
+        }
+    }
+
+    uint32_t n = (uint32_t)nomes.size();
+    uint32_t nBaldes = std::max(1u, n / 2);
+
+    // Hash and displace: baldes maiores primeiro, cada um procura uma semente que leve todas as
+    // suas chaves para posições ainda livres da tabela (de tamanho n, sem buracos)
+    vector<vector<uint32_t>> baldes(nBaldes);
+    for (uint32_t i = 0; i < n; i++)
+        baldes[hashNome(nomes[i].data(), nomes[i].size(), 0) % nBaldes].push_back(i);
+    vector<uint32_t> ordem(nBaldes);
+    for (uint32_t b = 0; b < nBaldes; b++)
+        ordem[b] = b;
+    sort(ordem.begin(), ordem.end(), [&](uint32_t a, uint32_t b) { return baldes[a].size() > baldes[b].size(); });
+
+    vector<uint32_t> sementes(nBaldes, 0);
+    vector<int> posicaoDe(n, -1); // posição na tabela -> índice em nomes
+    for (uint32_t b : ordem)
+    {
+        if (baldes[b].empty())
+            continue;
+        for (uint32_t semente = 1;; semente++)
+        {
+            vector<uint32_t> posicoes;
+            bool livre = true;
+            for (uint32_t i : baldes[b])
+            {
+                uint32_t p = (uint32_t)(hashNome(nomes[i].data(), nomes[i].size(), semente) % n);
+                if (posicaoDe[p] >= 0 || find(posicoes.begin(), posicoes.end(), p) != posicoes.end())
+                {
+                    livre = false;
+                    break;
+                }
+                posicoes.push_back(p);
+            }
+            if (!livre)
+                continue;
+            for (size_t k = 0; k < posicoes.size(); k++)
+                posicaoDe[posicoes[k]] = (int)baldes[b][k];
+            sementes[b] = semente;
+            break;
+        }
+    }
+
+    vector<EntradaBundle> entradas(n);
+    string blocoNomes;
+    uint64_t inicioNomes = sizeof(CabecalhoBundle) + nBaldes * sizeof(uint32_t) + (uint64_t)n * sizeof(EntradaBundle);
+    for (uint32_t p = 0; p < n; p++)
+    {
+        const string &nome = nomes[posicaoDe[p]];
+        entradas[p].hash = hashNome(nome.data(), nome.size(), 0);
+        entradas[p].offsetNome = (uint32_t)(inicioNomes + blocoNomes.size());
+        entradas[p].tamanhoNome = (uint32_t)nome.size();
+        blocoNomes += nome;
+    }
+
+    ofstream arquivo(saida, ios::binary);
+    if (!arquivo.is_open())
+    {
+        cerr << "Erro ao criar " << saida << "\n";
+        return 1;
+    }
+
+    uint64_t offset = inicioNomes + blocoNomes.size();
+    vector<vector<char>> dados(n);
+    for (uint32_t p = 0; p < n; p++)
+    {
+        ifstream origem(raiz + nomes[posicaoDe[p]], ios::binary);
+        dados[p].assign(istreambuf_iterator<char>(origem), istreambuf_iterator<char>());
+        offset = (offset + 15) & ~(uint64_t)15;
+        entradas[p].offset = offset;
+        entradas[p].tamanho = dados[p].size();
+        offset += dados[p].size();
+    }
+
+    CabecalhoBundle cabecalho = {};
+    memcpy(cabecalho.magia, MAGIA_BUNDLE, 4);
+    cabecalho.versao = VERSAO_BUNDLE;
+    cabecalho.nEntradas = n;
+    cabecalho.nBaldes = nBaldes;
+    arquivo.write((const char *)&cabecalho, sizeof(cabecalho));
+    arquivo.write((const char *)sementes.data(), sementes.size() * sizeof(uint32_t));
+    arquivo.write((const char *)entradas.data(), entradas.size() * sizeof(EntradaBundle));
+    arquivo << blocoNomes;
+    for (uint32_t p = 0; p < n; p++)
+    {
+        static const char zeros[16] = {};
+        arquivo.write(zeros, entradas[p].offset - (uint64_t)arquivo.tellp());
+        arquivo.write(dados[p].data(), dados[p].size());
+    }
+
+    cout << "Pacote de assets gravado: " << saida << " (" << n << " arquivos, " << offset / 1024 << " KiB)\n";
+    return 0;
+}
+
+// ================================
+// Cache de texturas por caminho
+// ================================
+// Cada caminho (normalizado) vira um handle estável. Quem usa a textura chama adquirirTextura e
+// liberarTextura; texturas sem referências continuam na GPU até o total passar do orçamento de
+// VRAM, quando as usadas há mais tempo são apagadas (LRU). Tiles e sprites guardam o handle, não
+// o nome GL, e o resolvem com texturaGL na hora do desenho: um handle apagado volta a carregar
+// sozinho ali ou na próxima aquisição.
+
+struct EntradaTextura
+{
+    string caminho;
+    GLuint texID = 0;    // 0 quando não está na GPU
+    int refs = 0;
+    size_t bytes = 0;    // estimativa, incluindo a cadeia de mipmaps
+    uint64_t ultimoUso = 0;
+    bool carregando = false;
+    bool falhou = false;  // a decodificação falhou: fica com o placeholder até ser despejada e pedida de novo
+};
+
+struct CacheTexturas
+{
+    vector<EntradaTextura> entradas; // handle = índice
+    unordered_map<string, int> handlePorCaminho;
+    size_t orcamentoBytes = 256u * 1024 * 1024;
+    size_t bytesResidentes = 0;
+    uint64_t relogio = 0;
+};
+
+CacheTexturas cacheTexturas;
+
+// preservar: handle que acabou de ser carregado e ainda não pode ser a vítima
+void despejarTexturasSeNecessario(int preservar = -1)
+{
+    while (cacheTexturas.bytesResidentes > cacheTexturas.orcamentoBytes)
+    {
+        int vitima = -1;
+        for (size_t i = 0; i < cacheTexturas.entradas.size(); i++)
+        {
+            const EntradaTextura &e = cacheTexturas.entradas[i];
+            if (e.texID != 0 && e.refs == 0 && !e.carregando && (int)i != preservar
+                && (vitima < 0 || e.ultimoUso < cacheTexturas.entradas[vitima].ultimoUso))
+                vitima = (int)i;
+        }
+        if (vitima < 0)
+            return; // tudo o que sobrou está em uso
+
+        EntradaTextura &e = cacheTexturas.entradas[vitima];
+        alfaTexturas.erase(e.texID);
+        apagarTextura(e.texID);
+        e.texID = 0;
+        cacheTexturas.bytesResidentes -= e.bytes;
+    }
+}
+
+// Coloca na GPU uma entrada que está fora dela: do pacote, se ela estiver lá, ou em segundo plano
+void carregarEntradaTextura(int handle)
+{
+    EntradaTextura &e = cacheTexturas.entradas[handle];
+    size_t bytes = 0;
+    e.texID = carregarTexturaDoPacote(e.caminho, bytes);
+    if (e.texID != 0)
+    {
+        e.bytes = bytes;
+        e.carregando = false;
+        cacheTexturas.bytesResidentes += bytes;
+        despejarTexturasSeNecessario(handle);
+    }
+    else
+    {
+        e.texID = carregarTexturaAssincrona(e.caminho);
+        e.bytes = 0;
+        e.carregando = true;
+        e.falhou = false;
+    }
+}
+
+int adquirirTextura(const string &caminho)
+{
+    string chave = filesystem::path(caminho).lexically_normal().generic_string();
+
+    int handle;
+    auto it = cacheTexturas.handlePorCaminho.find(chave);
+    if (it != cacheTexturas.handlePorCaminho.end())
+    {
+        handle = it->second;
+    }
+    else
+    {
+        handle = (int)cacheTexturas.entradas.size();
+        EntradaTextura entrada;
+        entrada.caminho = chave;
+        cacheTexturas.entradas.push_back(entrada);
+        cacheTexturas.handlePorCaminho[chave] = handle;
+    }
+
+    // A referência conta antes do carregamento: senão a própria entrada nova seria a vítima do despejo
+    EntradaTextura &e = cacheTexturas.entradas[handle];
+    e.refs++;
+    e.ultimoUso = ++cacheTexturas.relogio;
+    if (e.texID == 0)
+        carregarEntradaTextura(handle);
+    return handle;
+}
+
+// Nome GL do handle no momento do desenho (0 sem handle)
+GLuint texturaGL(int handle)
+{
+    if (handle < 0)
+        return 0;
+    EntradaTextura &e = cacheTexturas.entradas[handle];
+    e.ultimoUso = ++cacheTexturas.relogio;
+    if (e.texID == 0)
+        carregarEntradaTextura(handle);
+    return e.texID;
+}
+
+void liberarTextura(int handle)
+{
+    if (handle < 0)
+        return;
+    EntradaTextura &e = cacheTexturas.entradas[handle];
+    if (e.refs > 0)
+        e.refs--;
+    despejarTexturasSeNecessario();
+}
+
+// Aponta o handle de um tile ou sprite para outra textura, soltando a referência à anterior
+void trocarTextura(int &handle, const string &caminho)
+{
+    int novo = adquirirTextura(caminho);
+    liberarTextura(handle);
+    handle = novo;
+}
+
+// Chamado quando os pixels de uma textura chegam à GPU
+void registrarTamanhoTextura(GLuint texID, size_t bytes)
+{
+    for (EntradaTextura &e : cacheTexturas.entradas)
+    {
+        if (e.texID == texID && e.carregando)
+        {
+            e.bytes = bytes;
+            e.carregando = false;
+            cacheTexturas.bytesResidentes += bytes;
+            despejarTexturasSeNecessario();
+            return;
+        }
+    }
+}
+
+// Chamado quando a decodificação de uma textura falha; sem isso ela ficaria "carregando" e nunca seria despejada
+void registrarFalhaTextura(GLuint texID)
+{
+    for (EntradaTextura &e : cacheTexturas.entradas)
+    {
+        if (e.texID == texID && e.carregando)
+        {
+            e.carregando = false;
+            e.falhou = true;
+            return;
+        }
+    }
+}
+
+void relatorioTexturas()
+{
+    std::cout << "Texturas (" << cacheTexturas.bytesResidentes / 1024 << " KiB de "
+              << cacheTexturas.orcamentoBytes / 1024 << " KiB):" << std::endl;
+    for (size_t i = 0; i < cacheTexturas.entradas.size(); i++)
+    {
+        const EntradaTextura &e = cacheTexturas.entradas[i];
+        std::cout << "  [" << i << "] " << e.caminho << ": "
+                  << (e.texID == 0 ? "fora da GPU"
+                                   : e.carregando ? "carregando"
+                                   : e.falhou     ? "falhou"
+                                                  : to_string(e.bytes / 1024) + " KiB")
+                  << ", " << e.refs << " referência(s)" << std::endl;
+    }
+}
+
+// ================================
+// Profundidade isométrica
+// ================================
+// A sobreposição não depende da ordem dos draw calls: cada tile e sprite recebe um z calculado da
+// camada e da diagonal (i + j) em que está, e o teste de profundidade (GL_LEQUAL) decide quem fica na
+// frente. Camadas maiores ficam sempre na frente das menores; dentro de uma camada, diagonais menores
+// (mais perto da parte de baixo da tela) ficam na frente. Texels com alfa abaixo de ALFA_RECORTE são
+// descartados no fragment shader, então a parte transparente de um quad não escreve profundidade nem
+// esconde o que está atrás. Empates (mesma camada e diagonal) ficam com a ordem de envio.
+
+const int CAMADA_CHAO = 0;
+const int CAMADA_OBJETOS = 1;
+const int NUMERO_CAMADAS = 2;
+const float ALFA_RECORTE = 0.5f;
+
+// z no espaço do mundo: as projeções usam near = -1 e far = 1, e z maior fica mais perto
+float profundidadeIso(int camada, float diagonal)
+{
+    float maiorDiagonal = (float)(TILEMAP_HEIGHT + TILEMAP_WIDTH);
+    float dentroDaCamada = 1.0f - glm::clamp(diagonal / maiorDiagonal, 0.0f, 1.0f);
+    return -0.99f + 1.98f * (camada + 0.99f * dentroDaCamada) / NUMERO_CAMADAS;
+}
+
+// ================================
+// Modos de depuração do desenho (F5)
+// ================================
+// O F5 alterna entre o desenho normal e três visualizações do custo da cena:
+// - sobreposição: cada fragmento escrito soma 1 no vermelho do alvo da cena (blending aditivo, inclusive
+//   nos passos opacos), e a ampliação pinta a contagem com um mapa de calor (azul = 1, verde = 2,
+//   amarelo = 3, laranja = 4, vermelho = 5 ou mais);
+// - lotes: cada draw call recebe uma cor diferente;
+// - trocas de textura: draw calls que vincularam uma textura diferente da anterior ficam vermelhos.
+// Todo draw call da cena passa por desenharArrays. Nos modos de depuração, o mapa é desenhado tile
+// a tile, sem o cache, para que cada draw call apareça.
+
+const int DEPURACAO_DESLIGADA = 0;
+const int DEPURACAO_SOBREPOSICAO = 1;
+const int DEPURACAO_LOTES = 2;
+const int DEPURACAO_TROCAS_TEXTURA = 3;
+const int NUM_MODOS_DEPURACAO = 4;
+const char *NOMES_MODOS_DEPURACAO[NUM_MODOS_DEPURACAO] = {"desligado", "sobreposição", "lotes",
+                                                          "trocas de textura"};
+
+struct Depuracao
+{
+    int modo = DEPURACAO_DESLIGADA;
+    int desenhos = 0;         // draw calls no quadro atual
+    int trocasTextura = 0;
+    GLuint ultimaTextura = 0;
+    int desenhosUltimo = 0;   // do último quadro completo, para o título
+    int trocasTexturaUltimo = 0;
+};
+
+Depuracao depuracao;
+
+void alternarModoDepuracao()
+{
+    depuracao.modo = (depuracao.modo + 1) % NUM_MODOS_DEPURACAO;
+    std::cout << "Modo de depuração: " << NOMES_MODOS_DEPURACAO[depuracao.modo] << std::endl;
+    marcarQuadroSujo();
+}
+
+void iniciarQuadroDepuracao(GLuint shaderID)
+{
+    Depuracao &d = depuracao;
+    d.desenhosUltimo = d.desenhos;
+    d.trocasTexturaUltimo = d.trocasTextura;
+    d.desenhos = d.trocasTextura = 0;
+    d.ultimaTextura = 0;
+    uniform1i(shaderOpaco, "modoDepuracao", d.modo);
+    uniform1i(shaderID, "modoDepuracao", d.modo);
+}
+
+string resumoDepuracao()
+{
+    if (depuracao.modo == DEPURACAO_DESLIGADA)
+        return "";
+    return string(", ") + NOMES_MODOS_DEPURACAO[depuracao.modo] + ": " + to_string(depuracao.desenhosUltimo) +
+           " draws, " + to_string(depuracao.trocasTexturaUltimo) + " trocas de textura";
+}
+
+// Matizes espaçados pela razão áurea: lotes vizinhos ficam com cores bem diferentes
+vec4 corDoLote(int lote)
+{
+    float matiz = fmodf(lote * 0.618034f, 1.0f);
+    auto canal = [matiz](float deslocamento) {
+        float h = fmodf(matiz + deslocamento, 1.0f);
+        return glm::clamp(fabsf(h * 6.0f - 3.0f) - 1.0f, 0.0f, 1.0f);
+    };
+    return vec4(canal(0.0f), canal(2.0f / 3.0f), canal(1.0f / 3.0f), 1.0f);
+}
+
+void desenharArrays(GLuint shaderID, GLenum primitiva, GLsizei vertices)
+{
+    Depuracao &d = depuracao;
+    d.desenhos++;
+    GLuint textura = estadoGL.texturas[0][indiceAlvoTextura(GL_TEXTURE_2D)];
+    bool trocouTextura = textura != d.ultimaTextura;
+    d.ultimaTextura = textura;
+    if (trocouTextura)
+        d.trocasTextura++;
+
+    if (d.modo == DEPURACAO_DESLIGADA)
+    {
+        glDrawArrays(primitiva, 0, vertices);
+        return;
+    }
+    if (d.modo == DEPURACAO_SOBREPOSICAO)
+    {
+        // O passo pode ter desligado o blending; a contagem precisa dele, e o estado do passo volta depois
+        bool blendLigado = estadoGL.habilitado[GL_BLEND];
+        GLenum blend[4];
+        memcpy(blend, estadoGL.blend, sizeof(blend));
+        habilitarGL(GL_BLEND, true);
+        funcaoBlend(GL_ONE, GL_ONE);
+        glDrawArrays(primitiva, 0, vertices);
+        habilitarGL(GL_BLEND, blendLigado);
+        funcaoBlendSeparada(blend[0], blend[1], blend[2], blend[3]);
+        return;
+    }
+
+    vec4 cor = d.modo == DEPURACAO_LOTES ? corDoLote(d.desenhos)
+                                         : (trocouTextura ? vec4(1.0f, 0.1f, 0.1f, 1.0f) : vec4(0.2f, 0.3f, 0.5f, 1.0f));
+    uniform4fv(shaderID, "corDepuracao", value_ptr(cor));
+    glDrawArrays(primitiva, 0, vertices);
+}
+
+// ================================
+// Contornos justos dos sprites
+// ================================
+// Desenhar o retângulo inteiro de um frame gasta fill rate com texels transparentes, que o fragment
+// shader ainda precisa amostrar para descartar. Para cada frame de cada clip é calculado, a partir do
+// canal alfa da folha, o octógono convexo mais justo (limites em x, y e nas duas diagonais) que cobre
+// os texels que sobrevivem ao recorte. Os oito vértices de todos os frames ficam em um texture buffer,
+// e o vertex shader os busca pelo gl_VertexID, no mesmo frame que ele escolhe a partir do tempo. O
+// contorno de um clip é calculado no primeiro desenho depois de os pixels da folha chegarem; até lá,
+// o frame usa o retângulo inteiro.
+
+const int VERTICES_CONTORNO = 8;
+
+struct TabelaContornos
+{
+    GLuint tbo = 0;
+    GLuint textura = 0;
+    GLuint vaoVazio = 0; // a geometria vem toda do texture buffer
+    vector<char> pronto; // por clip
+};
+
+TabelaContornos contornos;
+
+// Octógono do frame com canto (c0, r0) na folha (linhas de cima para baixo), em frações do frame, com y
+// para cima e no sentido anti-horário; frame sem texels visíveis vira um octógono degenerado
+void calcularContorno(const AlfaTextura &a, int c0, int r0, int largura, int altura, GLfloat *saida)
+{
+    float minX = INFINITY, maxX = -INFINITY, minY = INFINITY, maxY = -INFINITY;
+    float minSoma = INFINITY, maxSoma = -INFINITY, minDif = INFINITY, maxDif = -INFINITY;
+    for (int k = 0; k < altura; k++)
+    {
+        for (int c = 0; c < largura; c++)
+        {
+            size_t texel = (size_t)((r0 + k) % a.altura) * a.largura + (c0 + c) % a.largura;
+            if (!a.alfa.empty() && a.alfa[texel] / 255.0f < ALFA_RECORTE)
+                continue;
+            // Canto inferior esquerdo do texel; o contorno cobre o quadrado inteiro
+            float x = (float)c, y = (float)(altura - 1 - k);
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x + 1.0f);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y + 1.0f);
+            minSoma = std::min(minSoma, x + y);
+            maxSoma = std::max(maxSoma, x + y + 2.0f);
+            minDif = std::min(minDif, x - y - 1.0f);
+            maxDif = std::max(maxDif, x + 1.0f - y);
+        }
+    }
+    if (minX > maxX)
+    {
+        std::fill(saida, saida + 2 * VERTICES_CONTORNO, 0.0f);
+        return;
+    }
+
+    const float vertices[2 * VERTICES_CONTORNO] = {
+        minSoma - minY, minY, maxDif + minY, minY, // base
+        maxX, maxX - maxDif, maxX, maxSoma - maxX, // lado direito
+        maxSoma - maxY, maxY, minDif + maxY, maxY, // topo
+        minX, minX - minDif, minX, minSoma - minX, // lado esquerdo
+    };
+    for (int v = 0; v < VERTICES_CONTORNO; v++)
+    {
+        saida[2 * v] = vertices[2 * v] / largura;
+        saida[2 * v + 1] = vertices[2 * v + 1] / altura;
+    }
+}
+
+// Texture buffer na unidade 3, começando com o retângulo inteiro de cada frame
+void criarTabelaContornos(GLuint shaderID)
+{
+    static const GLfloat retangulo[2 * VERTICES_CONTORNO] = {0, 0, 1, 0, 1, 0, 1, 1, 1, 1, 0, 1, 0, 1, 0, 0};
+    vector<GLfloat> dados;
+    for (size_t k = 0; k < tabelaUV.size(); k++)
+        dados.insert(dados.end(), retangulo, retangulo + 2 * VERTICES_CONTORNO);
+
+    glGenBuffers(1, &contornos.tbo);
+    vincularBuffer(GL_TEXTURE_BUFFER, contornos.tbo);
+    glBufferData(GL_TEXTURE_BUFFER, dados.size() * sizeof(GLfloat), dados.data(), GL_DYNAMIC_DRAW);
+    vincularBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glGenTextures(1, &contornos.textura);
+    vincularTextura(3, GL_TEXTURE_BUFFER, contornos.textura);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, contornos.tbo);
+    ativarUnidadeTextura(0);
+
+    glGenVertexArrays(1, &contornos.vaoVazio);
+    contornos.pronto.assign(clips.size(), 0);
+    uniform1i(shaderID, "tabelaContornos", 3);
+}
+
+void atualizarContorno(int clipID, GLuint texID)
+{
+    if (clipID < 0 || clipID >= (int)contornos.pronto.size() || contornos.pronto[clipID])
+        return;
+    auto it = alfaTexturas.find(texID);
+    if (it == alfaTexturas.end())
+        return; // folha ainda carregando
+    PERFIL_ZONA("atualizarContorno");
+
+    const ClipAnimacao &clip = clips[clipID];
+    const AlfaTextura &a = it->second;
+    float ds = 1.0f / clip.framesPorLinha, dt = 1.0f / clip.nLinhas;
+    int largura = std::max(1, (int)lround(ds * a.largura)), altura = std::max(1, (int)lround(dt * a.altura));
+
+    vector<GLfloat> dados(clip.nFrames * 2 * VERTICES_CONTORNO);
+    for (int f = 0; f < clip.nFrames; f++)
+    {
+        // Mesmas coordenadas do vertex shader: o frame vai de t = 1 - dt + uv.y até 1 + uv.y, com repetição
+        vec2 uv = tabelaUV[clip.primeiroFrame + f];
+        float t0 = 1.0f - dt + uv.y;
+        t0 -= floorf(t0);
+        int c0 = (int)lround(uv.x * a.largura) % a.largura, r0 = (int)lround(t0 * a.altura) % a.altura;
+        calcularContorno(a, c0, r0, largura, altura, &dados[f * 2 * VERTICES_CONTORNO]);
+    }
+
+    vincularBuffer(GL_TEXTURE_BUFFER, contornos.tbo);
+    glBufferSubData(GL_TEXTURE_BUFFER, clip.primeiroFrame * 2 * VERTICES_CONTORNO * sizeof(GLfloat),
+                    dados.size() * sizeof(GLfloat), dados.data());
+    vincularBuffer(GL_TEXTURE_BUFFER, 0);
+    contornos.pronto[clipID] = 1;
+}
+
+// Sprites com clip usam o contorno do frame atual; os outros, o quad do VAO
+void desenharGeometriaSprite(GLuint shaderID, const Sprite &sprite, bool comClip)
+{
+    if (comClip)
+    {
+        atualizarContorno(sprite.clipID, texturaGL(sprite.textura));
+        vincularVAO(contornos.vaoVazio);
+        desenharArrays(shaderID, GL_TRIANGLE_FAN, VERTICES_CONTORNO);
+        return;
+    }
+    vincularVAO(sprite.VAO);
+    desenharArrays(shaderID, GL_TRIANGLE_STRIP, 4);
+}
+
+// ================================
+// Câmera: área visível do mundo
+// ================================
+// O mundo do jogo é a área LARGURA_MUNDO x ALTURA_MUNDO (em unidades de um pixel de sprite). A câmera
+// escolhe o maior fator inteiro de pixels da janela por unidade com o qual essa área inteira ainda cabe
+// e mostra, com esse fator, tudo o que cabe na janela: janelas maiores ou com outra proporção mostram
+// mais mundo em volta, sem esticar a imagem. Janelas menores que o mundo mostram o mundo inteiro, com a
+// proporção da janela, e a cena é reduzida na ampliação. A projeção e os limites usados para descartar
+// o que está fora da tela vêm daqui.
+
+const int LARGURA_MUNDO = 1200, ALTURA_MUNDO = 800;
+
+// Tamanho do framebuffer da janela, em pixels
+int larguraFramebuffer = LARGURA_MUNDO, alturaFramebuffer = ALTURA_MUNDO;
+
+struct Camera
+{
+    vec2 centro = vec2(LARGURA_MUNDO / 2.0f, ALTURA_MUNDO / 2.0f);
+    vec4 limites;                       // xMin, yMin, xMax, yMax da área visível
+    int larguraAlvo = LARGURA_MUNDO;    // tamanho do alvo da cena, em texels (= unidades do mundo)
+    int alturaAlvo = ALTURA_MUNDO;
+    mat4 projecao = mat4(1);
+
+    // Sprite centrado em centroSprite; o que fica fora da área visível não precisa de draw call
+    bool visivel(const vec3 &centroSprite, const vec3 &dimensoes) const
+    {
+        return centroSprite.x - dimensoes.x / 2.0f < limites.z && centroSprite.x + dimensoes.x / 2.0f > limites.x &&
+               centroSprite.y - dimensoes.y / 2.0f < limites.w && centroSprite.y + dimensoes.y / 2.0f > limites.y;
+    }
+};
+
+Camera camera;
+
+void calcularCamera(int largura, int altura)
+{
+    int escala = std::min(largura / LARGURA_MUNDO, altura / ALTURA_MUNDO);
+    if (escala >= 1)
+    {
+        camera.larguraAlvo = largura / escala;
+        camera.alturaAlvo = altura / escala;
+    }
+    else
+    {
+        float proporcao = (float)largura / std::max(altura, 1);
+        bool maisLarga = proporcao > (float)LARGURA_MUNDO / ALTURA_MUNDO;
+        camera.larguraAlvo = maisLarga ? (int)lround(ALTURA_MUNDO * proporcao) : LARGURA_MUNDO;
+        camera.alturaAlvo = maisLarga ? ALTURA_MUNDO : (int)lround(LARGURA_MUNDO / proporcao);
+    }
+
+    vec2 metade = vec2(camera.larguraAlvo, camera.alturaAlvo) / 2.0f;
+    camera.limites = vec4(camera.centro.x - metade.x, camera.centro.y - metade.y, camera.centro.x + metade.x,
+                          camera.centro.y + metade.y);
+    camera.projecao = ortho(camera.limites.x, camera.limites.z, camera.limites.y, camera.limites.w, -1.0f, 1.0f);
+}
+
+// ================================
+// Tempos de GPU por passo
+// ================================
+// Cada passo de desenho (mapa, principal, moeda, overlay...) fica entre duas consultas
+// GL_TIMESTAMP. As consultas de um quadro só são lidas QUADROS_LATENCIA_GPU quadros depois,
+// quando o resultado já está pronto, então a CPU nunca espera pela GPU. Os tempos vão para
+// janelas móveis (p50/p95/p99), para o overlay (F3) e, opcionalmente, para um CSV.
+
+const int QUADROS_LATENCIA_GPU = 4;
+const int MAX_PASSOS_GPU = 16;
+const int JANELA_TEMPOS = 300;       // amostras usadas nos percentis (~5 s a 60 FPS)
+const float PIXELS_POR_MS = 40.0f;   // escala das barras do overlay
+
+struct EstatisticaTempo
+{
+    string nome;
+    vector<float> amostras; // anel com os últimos JANELA_TEMPOS tempos, em ms
+    int proxima = 0;
+    float ultima = 0.0f;
+    uint64_t total = 0; // amostras já recebidas
+
+    void adicionar(float ms)
+    {
+        ultima = ms;
+        total++;
+        if ((int)amostras.size() < JANELA_TEMPOS)
+            amostras.push_back(ms);
+        else
+            amostras[proxima] = ms;
+        proxima = (proxima + 1) % JANELA_TEMPOS;
+    }
+
+    float percentil(float p) const
+    {
+        if (amostras.empty())
+            return 0.0f;
+        vector<float> copia = amostras;
+        size_t k = std::min(copia.size() - 1, (size_t)(p * copia.size()));
+        nth_element(copia.begin(), copia.begin() + k, copia.end());
+        return copia[k];
+    }
+};
+
+struct TemporizadorGPU
+{
+    bool disponivel = false;
+    GLuint consultas[QUADROS_LATENCIA_GPU][MAX_PASSOS_GPU][2];
+    bool emUso[QUADROS_LATENCIA_GPU][MAX_PASSOS_GPU] = {};
+    uint64_t numeroQuadro[QUADROS_LATENCIA_GPU] = {};
+    int slot = 0;         // posição do quadro atual no anel
+    uint64_t nQuadros = 0;
+    int passoQuadro = -1; // o quadro inteiro também é um passo
+    vector<EstatisticaTempo> passos;
+    EstatisticaTempo cpu; // tempo de CPU para montar e enviar o quadro
+    bool overlay = false;
+    ofstream csv;
+    GLuint texturaBranca = 0;
+    GLuint vaoQuad = 0;
+};
+
+TemporizadorGPU temporizadorGPU;
+
+int passoGPU(const char *nome)
+{
+    for (size_t i = 0; i < temporizadorGPU.passos.size(); i++)
+        if (temporizadorGPU.passos[i].nome == nome)
+            return (int)i;
+    if ((int)temporizadorGPU.passos.size() == MAX_PASSOS_GPU)
+        return -1;
+    EstatisticaTempo passo;
+    passo.nome = nome;
+    temporizadorGPU.passos.push_back(passo);
+    return (int)temporizadorGPU.passos.size() - 1;
+}
+
+void iniciarTemporizadorGPU(const string &caminhoCsv)
+{
+    temporizadorGPU.cpu.nome = "cpu";
+
+    // Alguns drivers expõem as consultas mas sem contador (0 bits)
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    temporizadorGPU.disponivel = bits > 0;
+    if (temporizadorGPU.disponivel)
+        glGenQueries(QUADROS_LATENCIA_GPU * MAX_PASSOS_GPU * 2, &temporizadorGPU.consultas[0][0][0]);
+    else
+        std::cout << "Consultas de tempo da GPU indisponíveis; só o tempo de CPU será medido" << std::endl;
+
+    temporizadorGPU.passoQuadro = passoGPU("quadro");
+
+    if (!caminhoCsv.empty())
+    {
+        temporizadorGPU.csv.open(caminhoCsv);
+        if (temporizadorGPU.csv.is_open())
+            temporizadorGPU.csv << "quadro,passo,ms\n";
+        else
+            cerr << "Não foi possível criar " << caminhoCsv << endl;
+    }
+
+    // Recursos do overlay: um quadrado unitário e uma textura branca 1x1 que é tingida
+    float ds, dt;
+    temporizadorGPU.vaoQuad = setupSprite(1, 1, ds, dt);
+    const unsigned char branco[4] = {255, 255, 255, 255};
+    glGenTextures(1, &temporizadorGPU.texturaBranca);
+    vincularTextura(0, GL_TEXTURE_2D, temporizadorGPU.texturaBranca);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, branco);
+    vincularTextura(0, GL_TEXTURE_2D, 0);
+}
+
+void marcarPassoGPU(int passo, int ponta)
+{
+    if (!temporizadorGPU.disponivel || passo < 0)
+        return;
+    glQueryCounter(temporizadorGPU.consultas[temporizadorGPU.slot][passo][ponta], GL_TIMESTAMP);
+    if (ponta == 1)
+        temporizadorGPU.emUso[temporizadorGPU.slot][passo] = true;
+}
+
+struct ZonaGPU
+{
+    int passo;
+    ZonaGPU(const char *nome) : passo(passoGPU(nome)) { marcarPassoGPU(passo, 0); }
+    ~ZonaGPU() { marcarPassoGPU(passo, 1); }
+};
+
+// Lê as consultas do quadro que ocupava o slot atual e começa a medir o novo quadro
+void iniciarQuadroGPU()
+{
+    TemporizadorGPU &t = temporizadorGPU;
+    if (t.disponivel)
+    {
+        int s = t.slot;
+        for (int p = 0; p < (int)t.passos.size(); p++)
+        {
+            if (!t.emUso[s][p])
+                continue;
+            t.emUso[s][p] = false;
+
+            // Se a GPU estiver mais de QUADROS_LATENCIA_GPU quadros atrás, a amostra é descartada
+            GLint pronto = 0;
+            glGetQueryObjectiv(t.consultas[s][p][1], GL_QUERY_RESULT_AVAILABLE, &pronto);
+            if (!pronto)
+                continue;
+            GLuint64 inicio = 0, fim = 0;
+            glGetQueryObjectui64v(t.consultas[s][p][0], GL_QUERY_RESULT, &inicio);
+            glGetQueryObjectui64v(t.consultas[s][p][1], GL_QUERY_RESULT, &fim);
+            float ms = (float)((double)(fim - inicio) / 1.0e6);
+            t.passos[p].adicionar(ms);
+            if (t.csv.is_open())
+                t.csv << t.numeroQuadro[s] << ',' << t.passos[p].nome << ',' << ms << '\n';
+        }
+    }
+    t.numeroQuadro[t.slot] = t.nQuadros;
+    marcarPassoGPU(t.passoQuadro, 0);
+}
+
+void terminarQuadroGPU(double segundosCpu)
+{
+    TemporizadorGPU &t = temporizadorGPU;
+    marcarPassoGPU(t.passoQuadro, 1);
+    t.cpu.adicionar((float)(segundosCpu * 1000.0));
+    if (t.csv.is_open())
+        t.csv << t.nQuadros << ",cpu," << segundosCpu * 1000.0 << '\n';
+    t.slot = (t.slot + 1) % QUADROS_LATENCIA_GPU;
+    t.nQuadros++;
+}
+
+void relatorioTemposGPU()
+{
+    TemporizadorGPU &t = temporizadorGPU;
+    char linha[128];
+    std::cout << "Tempos (ms)              p50      p95      p99" << std::endl;
+    auto imprimir = [&](const EstatisticaTempo &e, const char *sufixo) {
+        snprintf(linha, sizeof(linha), "  %-20s %7.3f  %7.3f  %7.3f", (e.nome + sufixo).c_str(),
+                 e.percentil(0.50f), e.percentil(0.95f), e.percentil(0.99f));
+        std::cout << linha << std::endl;
+    };
+    for (const EstatisticaTempo &e : t.passos)
+        if (!e.amostras.empty())
+            imprimir(e, " (GPU)");
+    imprimir(t.cpu, " (envio)");
+
+    if (t.disponivel && t.passoQuadro >= 0 && !t.passos[t.passoQuadro].amostras.empty())
+    {
+        bool gpu = t.passos[t.passoQuadro].percentil(0.95f) > t.cpu.percentil(0.95f);
+        std::cout << "  Quadro limitado pela " << (gpu ? "GPU" : "CPU") << std::endl;
+    }
+}
+
+// Barras horizontais no canto superior esquerdo: p99 (escura), p95 e p50 (clara) de cada passo.
+// A linha vertical branca marca 16,7 ms (60 FPS).
+void desenharOverlayTempos(GLuint shaderID)
+{
+    TemporizadorGPU &t = temporizadorGPU;
+    // No mapa de sobreposição, o vermelho do alvo é uma contagem; as cores do overlay a estragariam
+    if (!t.overlay || depuracao.modo == DEPURACAO_SOBREPOSICAO)
+        return;
+    ZonaGPU zonaGPU("overlay");
+
+    static const vec3 cores[] = {vec3(0.9, 0.3, 0.3), vec3(0.3, 0.9, 0.3), vec3(0.3, 0.5, 1.0),
+                                 vec3(0.9, 0.9, 0.3), vec3(0.9, 0.3, 0.9), vec3(0.3, 0.9, 0.9)};
+
+    // O fundo do overlay é translúcido e fica por cima de tudo, sem teste de profundidade
+    habilitarGL(GL_DEPTH_TEST, false);
+    uniform1f(shaderID, "alfaMinimo", 0.0f);
+    uniform1i(shaderID, "modoDepuracao", DEPURACAO_DESLIGADA);
+    uniform1i(shaderID, "clipID", -1);
+    uniform2f(shaderID, "offsetTex", 0.0f, 0.0f);
+    usarPrograma(shaderID);
+    vincularVAO(t.vaoQuad);
+    vincularTextura(0, GL_TEXTURE_2D, t.texturaBranca);
+
+    auto barra = [&](float x, float y, float largura, float altura, vec4 cor) {
+        mat4 model = translate(mat4(1), vec3(x + largura / 2.0f, y, 0.0f));
+        model = scale(model, vec3(largura, altura, 1.0f));
+        uniformMatrix4fv(shaderID, "model", value_ptr(model));
+        uniform4fv(shaderID, "tint", value_ptr(cor));
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    };
+
+    float x0 = camera.limites.x + 20.0f, y = camera.limites.w - 20.0f;
+    vector<const EstatisticaTempo *> linhas;
+    for (const EstatisticaTempo &e : t.passos)
+        if (!e.amostras.empty())
+            linhas.push_back(&e);
+    linhas.push_back(&t.cpu);
+
+    barra(x0 - 4.0f, y - 6.0f * linhas.size() + 3.0f, 1000.0f / 60.0f * PIXELS_POR_MS + 8.0f,
+          12.0f * linhas.size() + 4.0f, vec4(0.0, 0.0, 0.0, 0.6));
+    for (size_t i = 0; i < linhas.size(); i++)
+    {
+        vec3 cor = cores[i % 6];
+        float yLinha = y - 12.0f * i;
+        barra(x0, yLinha, std::max(linhas[i]->percentil(0.99f) * PIXELS_POR_MS, 1.0f), 8.0f, vec4(cor * 0.35f, 1.0));
+        barra(x0, yLinha, std::max(linhas[i]->percentil(0.95f) * PIXELS_POR_MS, 1.0f), 8.0f, vec4(cor * 0.6f, 1.0));
+        barra(x0, yLinha, std::max(linhas[i]->percentil(0.50f) * PIXELS_POR_MS, 1.0f), 8.0f, vec4(cor, 1.0));
+    }
+    barra(x0 + 1000.0f / 60.0f * PIXELS_POR_MS, y - 6.0f * linhas.size() + 3.0f, 2.0f, 12.0f * linhas.size(),
+          vec4(1.0));
+
+    uniform4f(shaderID, "tint", 1.0f, 1.0f, 1.0f, 1.0f);
+    uniform1f(shaderID, "alfaMinimo", ALFA_RECORTE);
+    uniform1i(shaderID, "modoDepuracao", depuracao.modo);
+    habilitarGL(GL_DEPTH_TEST, true);
+}
+
+// ================================
+// Agendamento de quadros (espera por eventos quando nada muda)
+// ================================
+// O mapa é estático e a única animação contínua é o ciclo do personagem, então não é preciso desenhar
+// em todo vsync. Um quadro só é desenhado quando algo o sujou (tecla, textura nova, janela exposta ou
+// com foco alterado) ou quando algum sprite animado troca de frame; entre um e outro o loop dorme em
+// glfwWaitEventsTimeout até o próximo prazo. Sem foco, desenha no máximo QUADROS_POR_SEGUNDO_SEM_FOCO
+// vezes por segundo; minimizada, a janela não é desenhada. O overlay de tempos e o CSV (medições)
+// voltam a desenhar continuamente.
+
+const double QUADROS_POR_SEGUNDO_SEM_FOCO = 10.0;
+const double ESPERA_MAXIMA_S = 0.25; // acorda de vez em quando para manter os ticks do rewind em dia
+const double MARGEM_PRAZO_S = 0.001; // o shader calcula o frame em float; acorda um pouco depois da troca
+
+struct AgendadorQuadros
+{
+    bool sujo = true;
+    bool focada = true;
+    bool minimizada = false;
+    double ultimoQuadro = -1e9; // glfwGetTime() do último quadro desenhado
+    double prazoAnimacao = 0.0; // glfwGetTime() em que algum sprite troca de frame
+    double prazoAgendado = INFINITY; // quadro pedido para um instante (ex.: realocar depois de redimensionar)
+};
+
+AgendadorQuadros agendador;
+
+void marcarQuadroSujo()
+{
+    agendador.sujo = true;
+}
+
+// Um prazo que já passou (o quadro dele está sendo desenhado agora) é substituído, não mantido pelo min
+void agendarQuadro(double instante)
+{
+    if (agendador.prazoAgendado <= glfwGetTime())
+        agendador.prazoAgendado = instante;
+    else
+        agendador.prazoAgendado = std::min(agendador.prazoAgendado, instante);
+}
+
+// Tempo de animação em que o sprite troca de frame depois de "tempo" (infinito se não troca mais)
+double proximaTrocaDeFrame(const Sprite &sprite, double tempo)
+{
+    if (sprite.clipID < 0 || sprite.clipID >= (int)clips.size())
+        return INFINITY;
+    const ClipAnimacao &clip = clips[sprite.clipID];
+    if (clip.fps <= 0.0f || clip.nFrames <= 1)
+        return INFINITY;
+    double frame = floor(std::max(tempo - sprite.tempoInicio, 0.0) * clip.fps);
+    if (clip.modo == ANIMACAO_UMA_VEZ && frame >= clip.nFrames - 1)
+        return INFINITY;
+    return sprite.tempoInicio + (frame + 1.0) / clip.fps;
+}
+
+bool desenhoContinuo()
+{
+    return temporizadorGPU.overlay || temporizadorGPU.csv.is_open();
+}
+
+double prazoProximoQuadro(double agora)
+{
+    if (agendador.minimizada)
+        return INFINITY;
+    double prazo = (agendador.sujo || desenhoContinuo()) ? agora
+                                                         : std::min(agendador.prazoAnimacao, agendador.prazoAgendado);
+    if (!agendador.focada)
+        prazo = std::max(prazo, agendador.ultimoQuadro + 1.0 / QUADROS_POR_SEGUNDO_SEM_FOCO);
+    return prazo;
+}
+
+// Processa os eventos, dormindo até o próximo prazo se não houver nada para fazer agora
+void aguardarProximoQuadro()
+{
+    double agora = glfwGetTime();
+    double espera = std::min(prazoProximoQuadro(agora) - agora, ESPERA_MAXIMA_S);
+    if (espera <= 0.0)
+        glfwPollEvents();
+    else
+        glfwWaitEventsTimeout(espera);
+}
+
+bool deveDesenhar(double agora)
+{
+    return agora >= prazoProximoQuadro(agora);
+}
+
+void quadroDesenhado(double agora, double tempoAnimacao)
+{
+    double prazo = proximaTrocaDeFrame(principal, tempoAnimacao);
+    if (!coin.isCollect)
+        prazo = std::min(prazo, proximaTrocaDeFrame(coin, tempoAnimacao));
+    agendador.sujo = false;
+    // Um quadro desenhado antes do instante agendado (ex.: logo depois do redimensionamento) não o cumpre
+    if (agendador.prazoAgendado <= agora)
+        agendador.prazoAgendado = INFINITY;
+    agendador.ultimoQuadro = agora;
+    agendador.prazoAnimacao = agora + (prazo - tempoAnimacao) + MARGEM_PRAZO_S;
+}
+
+void focus_callback(GLFWwindow *window, int focada)
+{
+    agendador.focada = focada;
+    marcarQuadroSujo();
+}
+
+void iconify_callback(GLFWwindow *window, int minimizada)
+{
+    agendador.minimizada = minimizada;
+    marcarQuadroSujo();
+}
+
+// Janela exposta ou redimensionada ao vivo: desenha na hora, porque em alguns sistemas o loop principal
+// fica parado dentro da espera por eventos até o usuário soltar a borda da janela
+void refresh_callback(GLFWwindow *window)
+{
+    marcarQuadroSujo();
+    desenharQuadro(window);
+}
+
+// Protótipo da função de callback de teclado
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode);
+
+// Dimensões da janela (pode ser alterado em tempo de execução)
+const GLuint WIDTH = 1200, HEIGHT = 800;
+
+// Código fonte do Vertex Shader (em GLSL): ainda hardcoded
+// Quando clipID >= 0, o frame da animação é escolhido aqui a partir do tempo
+const GLchar *vertexShaderSource = R"(
+ #version 400
+ layout (location = 0) in vec3 position;
+ layout (location = 1) in vec2 texc;
+ out vec2 tex_coord;
+ out vec2 offset_frame;
+ uniform mat4 model;
+ uniform mat4 projection;
+ uniform vec2 offsetTex;
+ uniform float tempo;
+ uniform int clipID;
+ uniform float tempoInicio;
+ uniform samplerBuffer tabelaClips;  // primeiro frame, nº de frames, fps, modo
+ uniform samplerBuffer tabelaFrames; // deslocamento de textura e tamanho de cada frame
+ uniform samplerBuffer tabelaContornos; // 8 vértices (frações do frame) do contorno justo de cada frame
+ void main()
+ {
+	tex_coord = vec2(texc.s, 1.0 - texc.t);
+	gl_Position = projection * model * vec4(position, 1.0);
+
+	offset_frame = offsetTex;
+	if (clipID >= 0)
+	{
+		vec4 clip = texelFetch(tabelaClips, clipID);
+		int nFrames = int(clip.y);
+		int frame = int(floor(max(tempo - tempoInicio, 0.0) * clip.z));
+		int modo = int(clip.w);
+		if (modo == 0)      // loop
+			frame = frame % nFrames;
+		else if (modo == 1) // uma vez
+			frame = min(frame, nFrames - 1);
+		else                // vai e volta
+		{
+			int periodo = max(2 * nFrames - 2, 1);
+			frame = frame % periodo;
+			if (frame >= nFrames)
+				frame = periodo - frame;
+		}
+		int indice = int(clip.x) + frame;
+		vec4 dadosFrame = texelFetch(tabelaFrames, indice);
+		offset_frame = dadosFrame.xy;
+
+		// Geometria do contorno do frame, desenhado como triangle fan de 8 vértices
+		vec2 p = texelFetch(tabelaContornos, indice * 8 + gl_VertexID).xy;
+		tex_coord = vec2(p.x * dadosFrame.z, 1.0 - p.y * dadosFrame.w);
+		gl_Position = projection * model * vec4(p - 0.5, 0.0, 1.0);
+	}
+ }
+ )";
 
 // Código fonte do Fragment Shader (em GLSL): ainda hardcoded
 const GLchar *fragmentShaderSource = R"(
  #version 400
  in vec2 tex_coord;
+ in vec2 offset_frame;
  out vec4 color;
  uniform sampler2D tex_buff;
- uniform vec2 offsetTex;
+ uniform vec4 tint; // cor multiplicada na textura (branco no jogo; usado pelo overlay)
+ uniform float alfaMinimo; // recorte: texels mais transparentes não são desenhados nem escrevem profundidade
+ uniform int modoDepuracao; // DEPURACAO_*; 0 desenha normalmente
+ uniform vec4 corDepuracao; // cor do draw call nos modos de lotes e de trocas de textura
+
+ void main()
+ {
+	 color = texture(tex_buff,tex_coord + offset_frame) * tint;
+ #ifndef SEM_RECORTE
+	 if (color.a < alfaMinimo)
+		 discard;
+ #endif
+	 if (modoDepuracao == 1)      // sobreposição: soma 1/255 no vermelho, com blending aditivo
+		 color = vec4(1.0 / 255.0, 0.0, 0.0, 1.0);
+	 else if (modoDepuracao >= 2) // lotes e trocas de textura
+		 color = vec4(mix(color.rgb, corDepuracao.rgb, 0.7), color.a);
+ }
+ )";
+
+// A mesma fonte com uma definição do pré-processador logo depois do #version
+string comDefinicao(const GLchar *fonte, const string &definicao)
+{
+    string texto = fonte;
+    size_t fimVersao = texto.find('\n', texto.find("#version"));
+    return texto.insert(fimVersao + 1, " #define " + definicao + "\n");
+}
+
+// Variante para a geometria opaca: sem discard, o teste de profundidade pode rejeitar fragmentos antes do shader
+const string fragmentOpacoSource = comDefinicao(fragmentShaderSource, "SEM_RECORTE");
+
+// Ampliação da cena para a janela: um triângulo que cobre a viewport, sem buffer de vértices
+const GLchar *vertexAmpliacaoSource = R"(
+ #version 400
+ out vec2 uv;
+ void main()
+ {
+	vec2 posicao = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2)) * 2.0 - 1.0;
+	uv = posicao * 0.5 + 0.5;
+	gl_Position = vec4(posicao, 0.0, 1.0);
+ }
+ )";
+
+// "Sharp bilinear": a cor é constante dentro de cada texel e só a faixa de um pixel da tela na fronteira
+// entre texels é interpolada, o que evita os texels de larguras diferentes do nearest com escala não inteira
+const GLchar *fragmentAmpliacaoSource = R"(
+ #version 400
+ in vec2 uv;
+ out vec4 color;
+ uniform sampler2D cena;
+ uniform vec2 regiao; // texels desenhados (a resolução dinâmica pode usar só parte do alvo)
+ uniform vec2 escala; // pixels da tela por texel da cena
+ uniform int mapaCalor; // 1: o vermelho da cena é uma contagem de sobreposição
+
+ vec3 rampaCalor(float n)
+ {
+	vec3 cores[6] = vec3[](vec3(0.0), vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), vec3(1.0, 1.0, 0.0),
+	                       vec3(1.0, 0.5, 0.0), vec3(1.0, 0.0, 0.0));
+	float x = clamp(n, 0.0, 5.0);
+	int k = min(int(floor(x)), 4);
+	return mix(cores[k], cores[k + 1], x - float(k));
+ }
+
+ void main()
+ {
+	vec2 tamanho = vec2(textureSize(cena, 0));
+	vec2 texel = uv * regiao;
+	vec2 distancia = fract(texel) - 0.5;
+	vec2 regiao = max(0.5 - 0.5 / escala, 0.0);
+	vec2 f = (distancia - clamp(distancia, -regiao, regiao)) * max(escala, 1.0) + 0.5;
+	// Não deixa o filtro misturar texels de fora da região desenhada
+	vec2 ponto = clamp(floor(texel) + f, vec2(0.5), regiao - 0.5);
+	color = vec4(texture(cena, ponto / tamanho).rgb, 1.0);
+	if (mapaCalor == 1)
+		color = vec4(rampaCalor(color.r * 255.0), 1.0);
+ }
+ )";
+
+// Fundo em parallax: um triângulo que cobre a tela, no plano mais distante (z = 1)
+const GLchar *vertexParallaxSource = R"(
+ #version 400
+ out vec2 mundo;
+ uniform vec4 limites; // área do mundo visível: xMin, yMin, xMax, yMax
+ void main()
+ {
+	vec2 posicao = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2)) * 2.0 - 1.0;
+	mundo = mix(limites.xy, limites.zw, posicao * 0.5 + 0.5);
+	gl_Position = vec4(posicao, 1.0, 1.0);
+ }
+ )";
+
+// Compõe as camadas de trás para frente; cada uma desloca com uma fração do movimento da câmera.
+// Os texels vêm da textura virtual: a tabela de páginas diz em que slot do cache físico está cada
+// página; páginas que ainda não chegaram usam a versão reduzida (reserva) da camada
+const GLchar *fragmentParallaxSource = R"(
+ #version 400
+ in vec2 mundo;
+ out vec4 color;
+ uniform sampler2D cachePaginas;        // cache físico: slots de TAMANHO_SLOT x TAMANHO_SLOT texels
+ uniform usampler2DArray tabelaPaginas; // uma camada por imagem, um texel por página
+ uniform sampler2DArray reserva;        // cada camada inteira, em resolução reduzida
+ uniform int nCamadas;
+ uniform float fatores[16];
+ uniform vec2 centro;        // centro da câmera
+ uniform vec2 deslocamento;  // quanto a câmera andou desde que o fundo foi criado
+ uniform vec2 tamanhoCamada; // tamanho de uma camada em unidades do mundo
+ uniform vec2 texelsCamada;  // tamanho de uma camada em texels
+ uniform int modoDepuracao;
+ uniform vec4 corDepuracao;
+
+ const float TAMANHO_PAGINA = 128.0; // iguais às constantes do programa
+ const float BORDA_PAGINA = 1.0;
+ const int TAMANHO_SLOT = 130;
+ const uint PAGINA_VAZIA = 65535u;
+
+ vec4 amostrarCamada(vec2 uv, int k)
+ {
+	uv = vec2(fract(uv.x), clamp(uv.y, 0.0, 1.0)); // repete na horizontal
+	vec2 texel = uv * texelsCamada;
+	ivec2 pagina = min(ivec2(texel / TAMANHO_PAGINA), textureSize(tabelaPaginas, 0).xy - 1);
+	uint entrada = texelFetch(tabelaPaginas, ivec3(pagina, k), 0).r;
+	if (entrada == PAGINA_VAZIA)
+		return vec4(0.0);
+	if (entrada == 0u)
+		return textureLod(reserva, vec3(uv, float(k)), 0.0);
+
+	int slot = int(entrada) - 1;
+	int slotsPorLado = textureSize(cachePaginas, 0).x / TAMANHO_SLOT;
+	vec2 origem = vec2(slot % slotsPorLado, slot / slotsPorLado) * float(TAMANHO_SLOT) + BORDA_PAGINA;
+	vec2 local = texel - vec2(pagina) * TAMANHO_PAGINA;
+	return textureLod(cachePaginas, (origem + local) / vec2(textureSize(cachePaginas, 0)), 0.0);
+ }
 
  void main()
  {
-	 color = texture(tex_buff,tex_coord + offsetTex);
+	vec3 cor = vec3(0.0);
+	for (int k = 0; k < nCamadas; k++)
+	{
+		vec2 p = (mundo - centro + fatores[k] * deslocamento) / tamanhoCamada;
+		vec4 texel = amostrarCamada(vec2(p.x + 0.5, 0.5 - p.y), k);
+		cor = mix(cor, texel.rgb, texel.a);
+	}
+	color = vec4(cor, 1.0);
+	if (modoDepuracao == 1)
+		color = vec4(1.0 / 255.0, 0.0, 0.0, 1.0);
+	else if (modoDepuracao >= 2)
+		color = vec4(mix(color.rgb, corDepuracao.rgb, 0.7), 1.0);
  }
  )";
 
 vector<Tile> tileset;
 
+// Solta as referências do tileset e dos sprites antes de a janela (e o contexto) ir embora
+void liberarTexturasCena()
+{
+    for (Tile &tile : tileset)
+    {
+        liberarTextura(tile.textura);
+        tile.textura = -1;
+    }
+    liberarTextura(principal.textura);
+    principal.textura = -1;
+    liberarTextura(coin.textura);
+    coin.textura = -1;
+}
+
+GLuint shaderJogo = 0;  // programa usado pelos sprites e pelo mapa
+double tempoBase = 0.0; // origem do uniform "tempo" das animações
+
+// ================================
+// Alvo de renderização da cena (pixel art em baixa resolução)
+// ================================
+// A cena é desenhada em um FBO sem MSAA, na densidade nativa dos assets (um pixel de sprite por
+// unidade do mundo), e depois ampliada para a janela. Com escala inteira, a ampliação é um
+// glBlitFramebuffer com GL_NEAREST, centralizado com bordas pretas. Quando a janela é menor que a
+// cena, ou com --ampliacao suave, um shader "sharp bilinear" ocupa a maior área possível mantendo a
+// proporção e só interpola na fronteira entre texels.
+
+const int AMPLIACAO_AUTOMATICA = 0;
+const int AMPLIACAO_INTEIRA = 1;
+const int AMPLIACAO_SUAVE = 2;
+
+struct AlvoCena
+{
+    GLuint fbo = 0;
+    GLuint cor = 0;
+    GLuint profundidade = 0; // renderbuffer de depth
+    int largura = 0, altura = 0;
+    float escala = 1.0f; // fração desenhada de cada eixo (resolução dinâmica)
+    int larguraUsada = 0, alturaUsada = 0;
+    GLuint programaAmpliacao = 0;
+    GLuint vaoVazio = 0; // o perfil core exige um VAO, mesmo sem atributos
+    int modo = AMPLIACAO_AUTOMATICA;
+};
+
+AlvoCena alvoCena;
+
+void criarAlvoCena(int largura, int altura)
+{
+    if (alvoCena.fbo == 0)
+    {
+        glGenFramebuffers(1, &alvoCena.fbo);
+        glGenTextures(1, &alvoCena.cor);
+        glGenRenderbuffers(1, &alvoCena.profundidade);
+        glGenVertexArrays(1, &alvoCena.vaoVazio);
+    }
+
+    // GL_LINEAR para o sharp bilinear; o blit usa o próprio filtro (GL_NEAREST)
+    vincularTextura(0, GL_TEXTURE_2D, alvoCena.cor);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, largura, altura, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    vincularRenderbuffer(alvoCena.profundidade);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, largura, altura);
+    vincularRenderbuffer(0);
+
+    vincularFramebuffer(alvoCena.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, alvoCena.cor, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, alvoCena.profundidade);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cerr << "Framebuffer da cena incompleto" << endl;
+        exit(1);
+    }
+
+    alvoCena.largura = largura;
+    alvoCena.altura = altura;
+    alvoCena.larguraUsada = std::max(1, (int)lround(largura * alvoCena.escala));
+    alvoCena.alturaUsada = std::max(1, (int)lround(altura * alvoCena.escala));
+}
+
+void vincularAlvoCena()
+{
+    vincularFramebuffer(alvoCena.fbo);
+    definirViewport(0, 0, alvoCena.larguraUsada, alvoCena.alturaUsada);
+}
+
+// Amplia a cena para o framebuffer da janela
+void apresentarCena()
+{
+    ZonaGPU zonaGPU("ampliacao");
+
+    vincularFramebuffer(0);
+    definirViewport(0, 0, larguraFramebuffer, alturaFramebuffer);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    int escalaInteira = std::min(larguraFramebuffer / alvoCena.largura, alturaFramebuffer / alvoCena.altura);
+    bool cenaInteira = alvoCena.larguraUsada == alvoCena.largura && alvoCena.alturaUsada == alvoCena.altura;
+    bool mapaCalor = depuracao.modo == DEPURACAO_SOBREPOSICAO;
+    if (escalaInteira >= 1 && cenaInteira && alvoCena.modo != AMPLIACAO_SUAVE && !mapaCalor)
+    {
+        int largura = alvoCena.largura * escalaInteira, altura = alvoCena.altura * escalaInteira;
+        int x0 = (larguraFramebuffer - largura) / 2, y0 = (alturaFramebuffer - altura) / 2;
+        vincularFramebufferLeitura(alvoCena.fbo);
+        glBlitFramebuffer(0, 0, alvoCena.largura, alvoCena.altura, x0, y0, x0 + largura, y0 + altura,
+                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        vincularFramebufferLeitura(0);
+        return;
+    }
+
+    float escala = std::min((float)larguraFramebuffer / alvoCena.largura, (float)alturaFramebuffer / alvoCena.altura);
+    int largura = (int)(alvoCena.largura * escala), altura = (int)(alvoCena.altura * escala);
+    definirViewport((larguraFramebuffer - largura) / 2, (alturaFramebuffer - altura) / 2, largura, altura);
+
+    // O alfa da cena não é 1 onde houve blending; a ampliação é opaca
+    habilitarGL(GL_BLEND, false);
+    usarPrograma(alvoCena.programaAmpliacao);
+    uniform1i(alvoCena.programaAmpliacao, "cena", 0);
+    uniform1i(alvoCena.programaAmpliacao, "mapaCalor", mapaCalor ? 1 : 0);
+    uniform2f(alvoCena.programaAmpliacao, "regiao", (float)alvoCena.larguraUsada, (float)alvoCena.alturaUsada);
+    uniform2f(alvoCena.programaAmpliacao, "escala", (float)largura / alvoCena.larguraUsada,
+              (float)altura / alvoCena.alturaUsada);
+    vincularTextura(0, GL_TEXTURE_2D, alvoCena.cor);
+    vincularVAO(alvoCena.vaoVazio);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    habilitarGL(GL_BLEND, true);
+}
+
+// ================================
+// Fundo em parallax
+// ================================
+// As camadas de fundo de assets/sprites (céu, lua, nuvens, pássaros, rochas e pinheiros) são compostas em
+// um só draw call: um triângulo que cobre a tela, no plano mais distante, cujo fragment shader amostra
+// todas as camadas de trás para frente. Cada camada se desloca com uma fração (fator) do movimento da
+// câmera: 0 fica parada na tela, 1 anda junto com o mundo. Na horizontal as camadas se repetem. As
+// imagens não ficam inteiras na GPU: são amostradas de uma textura virtual (seção seguinte).
+
+const int MAX_CAMADAS_PARALLAX = 16; // tamanho do array de fatores no shader
+const int LARGURA_CAMADA_PARALLAX = 1920, ALTURA_CAMADA_PARALLAX = 1080;
+
+struct CamadaParallax
+{
+    const char *arquivo; // em assets/sprites
+    float fator;
+    int x, y;            // posição de imagens menores que a camada (pixels, a partir do canto superior esquerdo)
+};
+
+// De trás para frente
+const CamadaParallax CAMADAS_PARALLAX[] = {
+    {"sky.png", 0.0f, 0, 0},      {"moon.png", 0.02f, 1180, 60}, {"clouds_1.png", 0.05f, 0, 0},
+    {"clouds_2.png", 0.1f, 0, 0}, {"clouds_3.png", 0.15f, 0, 0}, {"birds.png", 0.2f, 0, 0},
+    {"rocks_1.png", 0.3f, 0, 0},  {"rocks_2.png", 0.4f, 0, 0},   {"rocks_3.png", 0.5f, 0, 0},
+    {"pines.png", 0.6f, 0, 0},
+};
+const int NUM_CAMADAS_PARALLAX = sizeof(CAMADAS_PARALLAX) / sizeof(CAMADAS_PARALLAX[0]);
+
+struct Parallax
+{
+    bool ligado = true;
+    GLuint programa = 0;
+    GLuint vaoVazio = 0;
+    vec2 centroInicial = vec2(0.0f); // centro da câmera quando o fundo foi criado
+};
+
+Parallax parallax;
+
+// ================================
+// Textura virtual do fundo (fundo.paginas)
+// ================================
+// Cada camada é cortada em páginas de 128x128 texels, com 1 texel de borda copiado das vizinhas para o
+// filtro bilinear não misturar páginas; páginas totalmente transparentes não são guardadas. Só as páginas
+// que a câmera vê em cada quadro vão para a GPU, em slots de um cache físico de tamanho fixo (--fundo-mb),
+// e uma tabela de páginas (textura de inteiros, um texel por página) diz ao shader em que slot cada uma
+// está. A memória de GPU do fundo não depende de quantas camadas ou de quão grandes elas são.
+//
+// A cópia das páginas roda no pool de threads e a thread principal só faz o glTexSubImage2D, com um limite
+// por quadro. Quando o cache enche, sai a página usada há mais tempo; se nem assim couber (tudo em uso no
+// quadro), a página aparece com a reserva: a camada inteira em 1/8 da resolução, sempre residente.
+//
+// As páginas são geradas offline com --empacotar-fundo e o arquivo é mapeado em memória, então ler uma
+// página é o que de fato a traz do disco. Sem o arquivo, as páginas são montadas a partir dos PNGs, no pool.
+//
+// Layout (little-endian):
+//   CabecalhoPaginasFundo
+//   uint64_t offsets[nCamadas][paginasY][paginasX]   (0 = página vazia)
+//   reserva: nCamadas imagens RGBA de larguraReserva x alturaReserva
+//   páginas: TAMANHO_SLOT x TAMANHO_SLOT texels RGBA cada
+
+const int TAMANHO_PAGINA = 128; // iguais às constantes do shader do parallax
+const int BORDA_PAGINA = 1;
+const int TAMANHO_SLOT = TAMANHO_PAGINA + 2 * BORDA_PAGINA;
+const size_t BYTES_PAGINA = (size_t)TAMANHO_SLOT * TAMANHO_SLOT * 4;
+const int PAGINAS_X = (LARGURA_CAMADA_PARALLAX + TAMANHO_PAGINA - 1) / TAMANHO_PAGINA;
+const int PAGINAS_Y = (ALTURA_CAMADA_PARALLAX + TAMANHO_PAGINA - 1) / TAMANHO_PAGINA;
+const int TOTAL_PAGINAS_FUNDO = NUM_CAMADAS_PARALLAX * PAGINAS_X * PAGINAS_Y;
+const int REDUCAO_RESERVA = 8; // 3 níveis de mipmap
+const int LARGURA_RESERVA = LARGURA_CAMADA_PARALLAX / REDUCAO_RESERVA;
+const int ALTURA_RESERVA = ALTURA_CAMADA_PARALLAX / REDUCAO_RESERVA;
+const size_t BYTES_RESERVA = (size_t)LARGURA_RESERVA * ALTURA_RESERVA * 4;
+const int PAGINAS_ENVIADAS_POR_QUADRO = 16; // ~1 MiB de glTexSubImage2D
+
+// Entradas da tabela de páginas; as demais são o slot + 1
+const GLushort PAGINA_NAO_RESIDENTE = 0;
+const GLushort PAGINA_VAZIA = 65535;
+
+const char MAGIA_PAGINAS_FUNDO[4] = {'P', 'G', 'F', 'D'};
+const uint32_t VERSAO_PAGINAS_FUNDO = 1;
+
+struct CabecalhoPaginasFundo
+{
+    char magia[4];
+    uint32_t versao;
+    uint32_t nCamadas;
+    uint32_t paginasX, paginasY;
+    uint32_t tamanhoPagina, borda;
+    uint32_t larguraReserva, alturaReserva;
+    uint32_t reservado;
+};
+
+const size_t INICIO_RESERVA_FUNDO = sizeof(CabecalhoPaginasFundo) + TOTAL_PAGINAS_FUNDO * sizeof(uint64_t);
+const size_t INICIO_PAGINAS_FUNDO = INICIO_RESERVA_FUNDO + NUM_CAMADAS_PARALLAX * BYTES_RESERVA;
+
+// Uma página copiada pelo pool, esperando o envio para o slot
+struct PaginaPronta
+{
+    int slot;
+    int pagina;
+    vector<unsigned char> texels;
+};
+
+struct FundoVirtual
+{
+    size_t orcamentoBytes = 40u * 1024 * 1024; // cache físico
+    ArquivoMapeado arquivo;                    // fundo.paginas mapeado, se existir
+    vector<unsigned char> memoria;             // ou as páginas montadas em segundo plano
+    const unsigned char *dados = nullptr;
+    atomic<bool> pronto{false}; // dados válidos
+    bool reservaEnviada = false;
+
+    GLuint cache = 0;   // GL_TEXTURE_2D com slotsPorLado x slotsPorLado slots
+    GLuint tabela = 0;  // GL_TEXTURE_2D_ARRAY GL_R16UI, PAGINAS_X x PAGINAS_Y por camada
+    GLuint reserva = 0; // GL_TEXTURE_2D_ARRAY
+    int slotsPorLado = 0;
+    vector<GLushort> entradas; // cópia da tabela de páginas
+    bool tabelaSuja = false;
+
+    vector<int> slotDaPagina;   // -1: não residente
+    vector<int> paginaDoSlot;   // -1: livre
+    vector<uint64_t> ultimoUso; // quadro em que a página do slot foi vista
+    vector<bool> carregando;    // cópia no pool ainda não enviada; o slot não pode ser reaproveitado
+    uint64_t quadro = 0;
+
+    mutex trava;
+    vector<PaginaPronta> prontas;
+};
+
+FundoVirtual fundoVirtual;
+
+const uint64_t *offsetsPaginasFundo(const unsigned char *dados)
+{
+    return (const uint64_t *)(dados + sizeof(CabecalhoPaginasFundo));
+}
+
+// Decodifica as camadas e as corta em páginas; devolve o conteúdo de fundo.paginas (vazio se falhou)
+vector<unsigned char> montarPaginasFundo()
+{
+    static_assert(LARGURA_CAMADA_PARALLAX % TAMANHO_PAGINA == 0, "a repetição horizontal supõe páginas inteiras");
+    static_assert(LARGURA_CAMADA_PARALLAX % REDUCAO_RESERVA == 0 && ALTURA_CAMADA_PARALLAX % REDUCAO_RESERVA == 0,
+                  "a reserva precisa de uma redução exata");
+
+    vector<unsigned char> saida(INICIO_PAGINAS_FUNDO, 0);
+    CabecalhoPaginasFundo cabecalho = {};
+    memcpy(cabecalho.magia, MAGIA_PAGINAS_FUNDO, 4);
+    cabecalho.versao = VERSAO_PAGINAS_FUNDO;
+    cabecalho.nCamadas = NUM_CAMADAS_PARALLAX;
+    cabecalho.paginasX = PAGINAS_X;
+    cabecalho.paginasY = PAGINAS_Y;
+    cabecalho.tamanhoPagina = TAMANHO_PAGINA;
+    cabecalho.borda = BORDA_PAGINA;
+    cabecalho.larguraReserva = LARGURA_RESERVA;
+    cabecalho.alturaReserva = ALTURA_RESERVA;
+    memcpy(saida.data(), &cabecalho, sizeof(cabecalho));
+
+    const int L = LARGURA_CAMADA_PARALLAX, A = ALTURA_CAMADA_PARALLAX;
+    vector<uint64_t> offsets(TOTAL_PAGINAS_FUNDO, 0);
+    vector<unsigned char> camada((size_t)L * A * 4);
+    vector<unsigned char> pagina(BYTES_PAGINA);
+
+    for (int k = 0; k < NUM_CAMADAS_PARALLAX; k++)
+    {
+        const CamadaParallax &c = CAMADAS_PARALLAX[k];
+        string caminho = string("assets/sprites/") + c.arquivo;
+        VisaoAsset asset;
+        int largura = 0, altura = 0, canais;
+        unsigned char *pixels = nullptr;
+        if (abrirAsset(caminho, asset))
+            pixels = stbi_load_from_memory(asset.dados, (int)asset.tamanho, &largura, &altura, &canais, 4);
+        if (!pixels || c.x + largura > L || c.y + altura > A)
+        {
+            cerr << "Falha ao montar a camada do fundo " << caminho << "\n";
+            if (pixels)
+                stbi_image_free(pixels);
+            return {};
+        }
+
+        // A imagem vai para (x, y) de uma camada transparente do tamanho padrão
+        std::fill(camada.begin(), camada.end(), 0);
+        for (int y = 0; y < altura; y++)
+            memcpy(&camada[((size_t)(c.y + y) * L + c.x) * 4], pixels + (size_t)y * largura * 4, (size_t)largura * 4);
+        stbi_image_free(pixels);
+
+        vector<unsigned char> reduzida = camada;
+        for (int l = L, a = A; l > LARGURA_RESERVA; l /= 2, a /= 2)
+            reduzida = reduzirNivelMip(reduzida.data(), l, a, 4);
+        memcpy(&saida[INICIO_RESERVA_FUNDO + k * BYTES_RESERVA], reduzida.data(), BYTES_RESERVA);
+
+        for (int py = 0; py < PAGINAS_Y; py++)
+        {
+            for (int px = 0; px < PAGINAS_X; px++)
+            {
+                // A borda repete na horizontal e estende a última linha na vertical, como o shader
+                bool vazia = true;
+                for (int y = 0; y < TAMANHO_SLOT; y++)
+                {
+                    int ty = glm::clamp(py * TAMANHO_PAGINA + y - BORDA_PAGINA, 0, A - 1);
+                    for (int x = 0; x < TAMANHO_SLOT; x++)
+                    {
+                        int tx = (px * TAMANHO_PAGINA + x - BORDA_PAGINA + L) % L;
+                        const unsigned char *texel = &camada[((size_t)ty * L + tx) * 4];
+                        memcpy(&pagina[((size_t)y * TAMANHO_SLOT + x) * 4], texel, 4);
+                        vazia = vazia && texel[3] == 0;
+                    }
+                }
+                if (vazia)
+                    continue;
+                offsets[(k * PAGINAS_Y + py) * PAGINAS_X + px] = saida.size();
+                saida.insert(saida.end(), pagina.begin(), pagina.end());
+            }
+        }
+    }
+
+    memcpy(&saida[sizeof(CabecalhoPaginasFundo)], offsets.data(), offsets.size() * sizeof(uint64_t));
+    return saida;
+}
+
+int empacotarFundo(const string &saida)
+{
+    vector<unsigned char> dados = montarPaginasFundo();
+    if (dados.empty())
+        return 1;
+
+    ofstream arquivo(saida, ios::binary);
+    if (!arquivo.is_open())
+    {
+        cerr << "Erro ao criar " << saida << "\n";
+        return 1;
+    }
+    arquivo.write((const char *)dados.data(), dados.size());
+
+    size_t nPaginas = (dados.size() - INICIO_PAGINAS_FUNDO) / BYTES_PAGINA;
+    cout << "Páginas do fundo gravadas: " << saida << " (" << nPaginas << " de " << TOTAL_PAGINAS_FUNDO
+         << " páginas não vazias, " << dados.size() / 1024 << " KiB)\n";
+    return 0;
+}
+
+bool paginasFundoValidas(const unsigned char *dados, size_t tamanho)
+{
+    const CabecalhoPaginasFundo *cabecalho = (const CabecalhoPaginasFundo *)dados;
+    if (tamanho < INICIO_PAGINAS_FUNDO || memcmp(cabecalho->magia, MAGIA_PAGINAS_FUNDO, 4) != 0
+        || cabecalho->versao != VERSAO_PAGINAS_FUNDO || cabecalho->nCamadas != (uint32_t)NUM_CAMADAS_PARALLAX
+        || cabecalho->paginasX != (uint32_t)PAGINAS_X || cabecalho->paginasY != (uint32_t)PAGINAS_Y
+        || cabecalho->tamanhoPagina != (uint32_t)TAMANHO_PAGINA || cabecalho->borda != (uint32_t)BORDA_PAGINA
+        || cabecalho->larguraReserva != (uint32_t)LARGURA_RESERVA || cabecalho->alturaReserva != (uint32_t)ALTURA_RESERVA)
+        return false;
+
+    const uint64_t *offsets = offsetsPaginasFundo(dados);
+    for (int i = 0; i < TOTAL_PAGINAS_FUNDO; i++)
+        if (offsets[i] != 0 && (offsets[i] < INICIO_PAGINAS_FUNDO || offsets[i] + BYTES_PAGINA > tamanho))
+            return false;
+    return true;
+}
+
+void abrirPaginasFundo(const string &caminho)
+{
+    FundoVirtual &fv = fundoVirtual;
+    if (mapearArquivo(caminho, fv.arquivo))
+    {
+        if (paginasFundoValidas(fv.arquivo.dados, fv.arquivo.tamanho))
+        {
+            fv.dados = fv.arquivo.dados;
+            fv.pronto = true;
+            cout << "Páginas do fundo: " << caminho << "\n";
+            return;
+        }
+        cerr << "Páginas do fundo inválidas (gere de novo com --empacotar-fundo): " << caminho << "\n";
+        desmapearArquivo(fv.arquivo);
+    }
+
+    // Sem o arquivo: as páginas são montadas na memória a partir das imagens, fora da thread principal
+    poolGlobal().enfileirar([] {
+        PERFIL_ZONA("montarPaginasFundo");
+        vector<unsigned char> paginas = montarPaginasFundo();
+        if (paginas.empty())
+            return;
+        fundoVirtual.memoria = std::move(paginas);
+        fundoVirtual.dados = fundoVirtual.memoria.data();
+        fundoVirtual.pronto.store(true, std::memory_order_release);
+        glfwPostEmptyEvent();
+    });
+}
+
+// Slot livre ou, se não houver, o da página usada há mais tempo (fora deste quadro); -1 se todos estão em uso
+int escolherSlotFundo()
+{
+    FundoVirtual &fv = fundoVirtual;
+    int escolhido = -1;
+    for (int slot = 0; slot < (int)fv.paginaDoSlot.size(); slot++)
+    {
+        if (fv.paginaDoSlot[slot] < 0)
+            return slot;
+        if (!fv.carregando[slot] && fv.ultimoUso[slot] < fv.quadro
+            && (escolhido < 0 || fv.ultimoUso[slot] < fv.ultimoUso[escolhido]))
+            escolhido = slot;
+    }
+    return escolhido;
+}
+
+// A página é vista neste quadro: se não está no cache, ganha um slot e o pool copia os texels dela.
+// Devolve false se o cache está cheio de páginas deste quadro.
+bool usarPaginaFundo(int pagina)
+{
+    FundoVirtual &fv = fundoVirtual;
+    int slot = fv.slotDaPagina[pagina];
+    if (slot < 0)
+    {
+        slot = escolherSlotFundo();
+        if (slot < 0)
+            return false;
+
+        int antiga = fv.paginaDoSlot[slot];
+        if (antiga >= 0)
+        {
+            fv.slotDaPagina[antiga] = -1;
+            fv.entradas[antiga] = PAGINA_NAO_RESIDENTE;
+            fv.tabelaSuja = true;
+        }
+        fv.paginaDoSlot[slot] = pagina;
+        fv.slotDaPagina[pagina] = slot;
+        fv.carregando[slot] = true;
+
+        const unsigned char *origem = fv.dados + offsetsPaginasFundo(fv.dados)[pagina];
+        poolGlobal().enfileirar([slot, pagina, origem] {
+            PERFIL_ZONA("lerPaginaFundo");
+            PaginaPronta pronta = {slot, pagina, vector<unsigned char>(origem, origem + BYTES_PAGINA)};
+            {
+                lock_guard<mutex> trava(fundoVirtual.trava);
+                fundoVirtual.prontas.push_back(std::move(pronta));
+            }
+            glfwPostEmptyEvent();
+        });
+    }
+    fv.ultimoUso[slot] = fv.quadro;
+    return true;
+}
+
+// Páginas que a câmera vê neste quadro, com a mesma conta do shader nos cantos da área visível e
+// 1 texel de margem para o filtro. As camadas da frente pedem primeiro: cobrem as de trás.
+void atualizarFundoVirtual()
+{
+    PERFIL_ZONA("atualizarFundoVirtual");
+    FundoVirtual &fv = fundoVirtual;
+    fv.quadro++;
+
+    const int L = LARGURA_CAMADA_PARALLAX, A = ALTURA_CAMADA_PARALLAX;
+    float escala = (float)ALTURA_MUNDO / A;
+    vec2 tamanho = vec2(L * escala, A * escala);
+    const uint64_t *offsets = offsetsPaginasFundo(fv.dados);
+    bool cacheCheio = false;
+
+    for (int k = NUM_CAMADAS_PARALLAX - 1; k >= 0; k--)
+    {
+        float fator = CAMADAS_PARALLAX[k].fator;
+        float dx = fator * (camera.centro.x - parallax.centroInicial.x) - camera.centro.x;
+        float dy = fator * (camera.centro.y - parallax.centroInicial.y) - camera.centro.y;
+        float u0 = ((camera.limites.x + dx) / tamanho.x + 0.5f) * L - 1.0f;
+        float u1 = ((camera.limites.z + dx) / tamanho.x + 0.5f) * L + 1.0f;
+        float v0 = (0.5f - (camera.limites.w + dy) / tamanho.y) * A - 1.0f;
+        float v1 = (0.5f - (camera.limites.y + dy) / tamanho.y) * A + 1.0f;
+
+        int px0 = (int)floorf(u0 / TAMANHO_PAGINA);
+        int px1 = std::min((int)floorf(u1 / TAMANHO_PAGINA), px0 + PAGINAS_X - 1); // no máximo uma volta
+        int py0 = glm::clamp((int)floorf(v0 / TAMANHO_PAGINA), 0, PAGINAS_Y - 1);
+        int py1 = glm::clamp((int)floorf(v1 / TAMANHO_PAGINA), 0, PAGINAS_Y - 1);
+
+        for (int py = py0; py <= py1; py++)
+        {
+            for (int px = px0; px <= px1; px++)
+            {
+                int pagina = (k * PAGINAS_Y + py) * PAGINAS_X + (px % PAGINAS_X + PAGINAS_X) % PAGINAS_X;
+                if (offsets[pagina] == 0)
+                    continue;
+                if (fv.slotDaPagina[pagina] >= 0)
+                    fv.ultimoUso[fv.slotDaPagina[pagina]] = fv.quadro;
+                else if (!cacheCheio)
+                    cacheCheio = !usarPaginaFundo(pagina);
+            }
+        }
+    }
+}
+
+void enviarTabelaPaginas()
+{
+    FundoVirtual &fv = fundoVirtual;
+    if (!fv.tabelaSuja)
+        return;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    vincularTextura(5, GL_TEXTURE_2D_ARRAY, fv.tabela);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, PAGINAS_X, PAGINAS_Y, NUM_CAMADAS_PARALLAX, GL_RED_INTEGER,
+                    GL_UNSIGNED_SHORT, fv.entradas.data());
+    fv.tabelaSuja = false;
+}
+
+// Na thread principal, a cada volta do loop: a reserva quando as páginas ficam prontas e as páginas que o
+// pool já copiou, até PAGINAS_ENVIADAS_POR_QUADRO
+void processarPaginasFundo()
+{
+    PERFIL_ZONA("processarPaginasFundo");
+    FundoVirtual &fv = fundoVirtual;
+    if (!parallax.ligado || !fv.pronto.load(std::memory_order_acquire))
+        return;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (!fv.reservaEnviada)
+    {
+        vincularTextura(6, GL_TEXTURE_2D_ARRAY, fv.reserva);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, LARGURA_RESERVA, ALTURA_RESERVA, NUM_CAMADAS_PARALLAX, GL_RGBA,
+                        GL_UNSIGNED_BYTE, fv.dados + INICIO_RESERVA_FUNDO);
+
+        // Páginas vazias nunca ocupam slot: o shader devolve transparente direto da tabela
+        const uint64_t *offsets = offsetsPaginasFundo(fv.dados);
+        for (int i = 0; i < TOTAL_PAGINAS_FUNDO; i++)
+            if (offsets[i] == 0)
+                fv.entradas[i] = PAGINA_VAZIA;
+        fv.tabelaSuja = true;
+        fv.reservaEnviada = true;
+    }
+
+    vector<PaginaPronta> prontas;
+    {
+        lock_guard<mutex> trava(fv.trava);
+        size_t n = std::min(fv.prontas.size(), (size_t)PAGINAS_ENVIADAS_POR_QUADRO);
+        prontas.assign(std::make_move_iterator(fv.prontas.end() - n), std::make_move_iterator(fv.prontas.end()));
+        fv.prontas.resize(fv.prontas.size() - n);
+    }
+    if (!prontas.empty())
+        vincularTextura(4, GL_TEXTURE_2D, fv.cache);
+    for (const PaginaPronta &pronta : prontas)
+    {
+        int x = pronta.slot % fv.slotsPorLado * TAMANHO_SLOT, y = pronta.slot / fv.slotsPorLado * TAMANHO_SLOT;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, TAMANHO_SLOT, TAMANHO_SLOT, GL_RGBA, GL_UNSIGNED_BYTE, pronta.texels.data());
+        fv.carregando[pronta.slot] = false;
+        fv.entradas[pronta.pagina] = (GLushort)(pronta.slot + 1);
+        fv.tabelaSuja = true;
+    }
+
+    if (fv.tabelaSuja)
+    {
+        enviarTabelaPaginas();
+        marcarQuadroSujo();
+    }
+}
+
+void criarParallax()
+{
+    if (!parallax.ligado)
+        return;
+    static_assert(NUM_CAMADAS_PARALLAX <= MAX_CAMADAS_PARALLAX, "camadas demais para o shader do parallax");
+    FundoVirtual &fv = fundoVirtual;
+
+    // Cache físico: o maior quadrado de slots que cabe no orçamento, no tamanho máximo de textura e na tabela
+    GLint tamanhoMaximo = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &tamanhoMaximo);
+    int slotsPorLado = (int)sqrt((double)fv.orcamentoBytes / BYTES_PAGINA);
+    fv.slotsPorLado = glm::clamp(slotsPorLado, 1, std::min(tamanhoMaximo / TAMANHO_SLOT, 255));
+    int ladoCache = fv.slotsPorLado * TAMANHO_SLOT;
+
+    glGenTextures(1, &fv.cache);
+    vincularTextura(4, GL_TEXTURE_2D, fv.cache);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, ladoCache, ladoCache, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    fv.entradas.assign(TOTAL_PAGINAS_FUNDO, PAGINA_NAO_RESIDENTE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glGenTextures(1, &fv.tabela);
+    vincularTextura(5, GL_TEXTURE_2D_ARRAY, fv.tabela);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R16UI, PAGINAS_X, PAGINAS_Y, NUM_CAMADAS_PARALLAX, 0, GL_RED_INTEGER,
+                 GL_UNSIGNED_SHORT, fv.entradas.data());
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &fv.reserva);
+    vincularTextura(6, GL_TEXTURE_2D_ARRAY, fv.reserva);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, LARGURA_RESERVA, ALTURA_RESERVA, NUM_CAMADAS_PARALLAX, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    int nSlots = fv.slotsPorLado * fv.slotsPorLado;
+    fv.slotDaPagina.assign(TOTAL_PAGINAS_FUNDO, -1);
+    fv.paginaDoSlot.assign(nSlots, -1);
+    fv.ultimoUso.assign(nSlots, 0);
+    fv.carregando.assign(nSlots, false);
+    cout << "Fundo: cache de " << nSlots << " páginas (" << (size_t)ladoCache * ladoCache * 4 / (1024 * 1024)
+         << " MiB) para " << TOTAL_PAGINAS_FUNDO << " páginas virtuais\n";
+
+    abrirPaginasFundo(resolverCaminho("assets/fundo.paginas"));
+
+    glGenVertexArrays(1, &parallax.vaoVazio);
+    parallax.centroInicial = camera.centro;
+
+    GLfloat fatores[MAX_CAMADAS_PARALLAX] = {};
+    for (int k = 0; k < NUM_CAMADAS_PARALLAX; k++)
+        fatores[k] = CAMADAS_PARALLAX[k].fator;
+    uniform1i(parallax.programa, "cachePaginas", 4);
+    uniform1i(parallax.programa, "tabelaPaginas", 5);
+    uniform1i(parallax.programa, "reserva", 6);
+    uniform1i(parallax.programa, "nCamadas", NUM_CAMADAS_PARALLAX);
+    uniform1fv(parallax.programa, "fatores", MAX_CAMADAS_PARALLAX, fatores);
+    // A altura de uma camada ocupa a altura do mundo
+    float escala = (float)ALTURA_MUNDO / ALTURA_CAMADA_PARALLAX;
+    uniform2f(parallax.programa, "tamanhoCamada", LARGURA_CAMADA_PARALLAX * escala, ALTURA_CAMADA_PARALLAX * escala);
+    uniform2f(parallax.programa, "texelsCamada", LARGURA_CAMADA_PARALLAX, ALTURA_CAMADA_PARALLAX);
+}
+
+// Desenhado depois dos sprites opacos (que já escreveram profundidade) e antes do mapa; não escreve
+// profundidade. Até a reserva chegar, não há fundo.
+void desenharParallax()
+{
+    FundoVirtual &fv = fundoVirtual;
+    if (!parallax.ligado || !fv.reservaEnviada)
+        return;
+    ZonaGPU zonaGPU("fundo");
+
+    atualizarFundoVirtual();
+    enviarTabelaPaginas(); // páginas que saíram do cache neste quadro
+
+    GLuint programa = parallax.programa;
+    uniform4fv(programa, "limites", value_ptr(camera.limites));
+    uniform2f(programa, "centro", camera.centro.x, camera.centro.y);
+    uniform2f(programa, "deslocamento", camera.centro.x - parallax.centroInicial.x,
+              camera.centro.y - parallax.centroInicial.y);
+    uniform1i(programa, "modoDepuracao", depuracao.modo);
+    usarPrograma(programa);
+
+    vincularTextura(4, GL_TEXTURE_2D, fv.cache);
+    vincularTextura(5, GL_TEXTURE_2D_ARRAY, fv.tabela);
+    vincularTextura(6, GL_TEXTURE_2D_ARRAY, fv.reserva);
+    vincularVAO(parallax.vaoVazio);
+    habilitarGL(GL_BLEND, false);
+    mascaraDepth(false);
+    desenharArrays(programa, GL_TRIANGLES, 3);
+    mascaraDepth(true);
+    habilitarGL(GL_BLEND, true);
+}
+
+// ================================
+// Resolução dinâmica
+// ================================
+// Mede o tempo de GPU de cada quadro (consultas de timestamp) e ajusta a fração do alvo da cena que é
+// desenhada para manter o FPS alvo. O alvo não é realocado: a viewport encolhe e a projeção da câmera
+// continua a mesma, então as coordenadas do jogo não mudam; a ampliação usa só a
+// região desenhada. Para não oscilar, a escala cai depressa (alguns quadros acima do orçamento) e sobe
+// devagar (muitos quadros com folga), e a faixa entre os dois limiares não muda nada.
+
+const float LIMIAR_REDUCAO = 0.90f;   // fração do orçamento acima da qual o quadro está "pesado"
+const float LIMIAR_AUMENTO = 0.70f;   // abaixo disto há folga para subir a escala
+const int QUADROS_PARA_REDUZIR = 8;
+const int QUADROS_PARA_AUMENTAR = 90;
+const float PASSO_ESCALA = 0.05f;
+
+struct ResolucaoDinamica
+{
+    double orcamentoMs = 1000.0 / 60.0;
+    float escalaMinima = 0.5f;
+    float escalaMaxima = 1.0f;
+    int quadrosPesados = 0;
+    int quadrosLeves = 0;
+    uint64_t amostrasVistas = 0;
+};
+
+ResolucaoDinamica resolucaoDinamica;
+
+void definirEscalaCena(float escala)
+{
+    alvoCena.escala = escala;
+    alvoCena.larguraUsada = std::max(1, (int)lround(alvoCena.largura * escala));
+    alvoCena.alturaUsada = std::max(1, (int)lround(alvoCena.altura * escala));
+    marcarQuadroSujo();
+}
+
+// Chamado uma vez por quadro desenhado; usa só amostras de GPU novas
+void atualizarResolucaoDinamica()
+{
+    ResolucaoDinamica &r = resolucaoDinamica;
+    const EstatisticaTempo &gpu = temporizadorGPU.passos[temporizadorGPU.passoQuadro];
+    if (!temporizadorGPU.disponivel || r.escalaMinima >= r.escalaMaxima || gpu.total == r.amostrasVistas)
+        return;
+    r.amostrasVistas = gpu.total;
+
+    float fracao = (float)(gpu.ultima / r.orcamentoMs);
+    r.quadrosPesados = fracao > LIMIAR_REDUCAO ? r.quadrosPesados + 1 : 0;
+    r.quadrosLeves = fracao < LIMIAR_AUMENTO ? r.quadrosLeves + 1 : 0;
+
+    float escala = alvoCena.escala;
+    if (r.quadrosPesados >= QUADROS_PARA_REDUZIR)
+    {
+        // O custo é proporcional à área, então a escala cai com a raiz da razão; no mínimo um passo
+        float alvo = escala * sqrtf(LIMIAR_AUMENTO / fracao);
+        escala = std::min(escala - PASSO_ESCALA, floorf(alvo / PASSO_ESCALA) * PASSO_ESCALA);
+        r.quadrosPesados = 0;
+    }
+    else if (r.quadrosLeves >= QUADROS_PARA_AUMENTAR)
+    {
+        escala += PASSO_ESCALA;
+        r.quadrosLeves = 0;
+    }
+    escala = glm::clamp(escala, r.escalaMinima, r.escalaMaxima);
+    if (escala != alvoCena.escala)
+    {
+        definirEscalaCena(escala);
+        std::cout << "Resolução da cena: " << alvoCena.larguraUsada << "x" << alvoCena.alturaUsada << " ("
+                  << (int)lround(escala * 100) << "%)" << std::endl;
+    }
+}
+
+// ================================
+// Redimensionamento da janela
+// ================================
+// O callback só anota o tamanho novo; o alvo da cena é realocado e a câmera recalculada quando o
+// tamanho fica parado por ATRASO_REALOCACAO_S. Durante o redimensionamento ao vivo, os quadros usam o
+// alvo antigo, ampliado para o tamanho atual da janela, em vez de realocar a cada evento.
+
+const double ATRASO_REALOCACAO_S = 0.15;
+
+struct Redimensionamento
+{
+    bool pendente = false;
+    double instante = 0.0; // glfwGetTime() do último evento de tamanho
+};
+
+Redimensionamento redimensionamento;
+
+void framebuffer_size_callback(GLFWwindow *window, int largura, int altura)
+{
+    if (largura <= 0 || altura <= 0)
+        return; // minimizada em alguns sistemas
+    larguraFramebuffer = largura;
+    alturaFramebuffer = altura;
+    redimensionamento.pendente = true;
+    redimensionamento.instante = glfwGetTime();
+    marcarQuadroSujo();
+    agendarQuadro(redimensionamento.instante + ATRASO_REALOCACAO_S);
+}
+
+// Recalcula a câmera e realoca o alvo da cena, se o tamanho já estabilizou (ou sempre, com forcar)
+void aplicarRedimensionamento(GLuint shaderID, bool forcar)
+{
+    if (!forcar && !redimensionamento.pendente)
+        return;
+    if (!forcar && glfwGetTime() - redimensionamento.instante < ATRASO_REALOCACAO_S)
+    {
+        // A janela mudou de novo depois do prazo antigo: espera o tamanho estabilizar a partir da última mudança
+        agendarQuadro(redimensionamento.instante + ATRASO_REALOCACAO_S);
+        return;
+    }
+    redimensionamento.pendente = false;
+
+    calcularCamera(larguraFramebuffer, alturaFramebuffer);
+    if (camera.larguraAlvo != alvoCena.largura || camera.alturaAlvo != alvoCena.altura)
+        criarAlvoCena(camera.larguraAlvo, camera.alturaAlvo);
+    uniformMatrix4fv(shaderOpaco, "projection", value_ptr(camera.projecao));
+    uniformMatrix4fv(shaderID, "projection", value_ptr(camera.projecao));
+    marcarQuadroSujo();
+}
+
 // Função MAIN
-int main()
+int main(int argc, char **argv)
 {
 
-    carregarMapaTxt("../src/ExemplosMoodle/M6_Material/Mapa.txt");
+    abrirBundle(resolverCaminho("assets.bundle"));
+
+    carregarMapaTxt("src/ExemplosMoodle/M6_Material/Mapa.txt");
     if (map.empty()) {
         cerr << "Mapa não carregado corretamente.\n";
         exit(1);
     }
 
+    modeloMapa = criarModeloDoMapaAtual();
+
+    // Opções
+    string caminhoCsvTempos;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (string(argv[i]) == "--vram-mb")
+            cacheTexturas.orcamentoBytes = (size_t)atoi(argv[i + 1]) * 1024 * 1024;
+        else if (string(argv[i]) == "--tempos-csv")
+            caminhoCsvTempos = argv[i + 1];
+        else if (string(argv[i]) == "--fps-alvo")
+            resolucaoDinamica.orcamentoMs = 1000.0 / std::max(atof(argv[i + 1]), 1.0);
+        else if (string(argv[i]) == "--escala-minima")
+            resolucaoDinamica.escalaMinima = glm::clamp((float)atof(argv[i + 1]), 0.1f, 1.0f);
+        else if (string(argv[i]) == "--ampliacao")
+            alvoCena.modo = string(argv[i + 1]) == "suave" ? AMPLIACAO_SUAVE : AMPLIACAO_INTEIRA;
+        else if (string(argv[i]) == "--fundo")
+            parallax.ligado = string(argv[i + 1]) != "nao";
+        else if (string(argv[i]) == "--fundo-mb")
+            fundoVirtual.orcamentoBytes = (size_t)std::max(atoi(argv[i + 1]), 1) * 1024 * 1024;
+    }
+
+    // Modos sem janela
+    if (argc >= 2 && string(argv[1]) == "--ambiente") {
+        int nAmbientes = argc >= 3 ? atoi(argv[2]) : 1024;
+        int nPassos = argc >= 4 ? atoi(argv[3]) : 1000;
+        medirAmbienteVetorizado(nAmbientes, nPassos);
+        return 0;
+    }
+    if (argc >= 2 && string(argv[1]) == "--empacotar-texturas") {
+        string saida = argc >= 3 ? argv[2] : raizProjeto() + "/assets/texturas.pack";
+        return empacotarTexturas(saida, vector<string>(argv + (argc >= 3 ? 3 : 2), argv + argc));
+    }
+    if (argc >= 2 && string(argv[1]) == "--empacotar-fundo") {
+        return empacotarFundo(argc >= 3 ? argv[2] : raizProjeto() + "/assets/fundo.paginas");
+    }
+    if (argc >= 2 && string(argv[1]) == "--empacotar-assets") {
+        return empacotarAssets(argc >= 3 ? argv[2] : raizProjeto() + "/assets.bundle");
+    }
+    if (argc >= 2 && string(argv[1]) == "--resolver") {
+        verificarNiveis(vector<string>(argv + 2, argv + argc));
+        return 0;
+    }
+
     // Inicialização da GLFW
     glfwInit();
 
@@ -254,8 +4860,9 @@ int main()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    // Ativa a suavização de serrilhado (MSAA) com 8 amostras por pixel
-    glfwWindowHint(GLFW_SAMPLES, 8);
+    // Sem MSAA nem depth na janela: a cena é pixel art desenhada em um alvo próprio e só ampliada para a janela
+    glfwWindowHint(GLFW_SAMPLES, 0);
+    glfwWindowHint(GLFW_DEPTH_BITS, 0);
 
     // Essencial para computadores da Apple
     // #ifdef __APPLE__
@@ -274,6 +4881,10 @@ int main()
 
     // Fazendo o registro da função de callback para a janela GLFW
     glfwSetKeyCallback(window, key_callback);
+    glfwSetWindowFocusCallback(window, focus_callback);
+    glfwSetWindowIconifyCallback(window, iconify_callback);
+    glfwSetWindowRefreshCallback(window, refresh_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
     // GLAD: carrega todos os ponteiros d funções da OpenGL
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -281,6 +4892,10 @@ int main()
         std::cerr << "Falha ao inicializar GLAD" << std::endl;
         return -1;
     }
+    instalarInstrumentacaoGL();
+
+    // Sincroniza a troca de buffers com o monitor: quando o desenho é contínuo, não passa da taxa da tela
+    glfwSwapInterval(1);
 
     // Obtendo as informações de versão
     const GLubyte *renderer = glGetString(GL_RENDERER); /* get renderer string */
@@ -289,33 +4904,55 @@ int main()
     cout << "OpenGL version supported " << version << endl;
 
     // Definindo as dimensões da viewport com as mesmas dimensões da janela da aplicação
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-    glViewport(0, 0, width, height);
-
-    // Compilando e buildando o programa de shader
-    GLuint shaderID = setupShader();
-
-    // Carregando uma textura
-    int imgWidth, imgHeight;
-    string tilesetPath = std::string("../assets/tilesets/") + TILESET_FILENAME;
-
-    GLuint texID = loadTexture(tilesetPath, imgWidth, imgHeight);
+    glfwGetFramebufferSize(window, &larguraFramebuffer, &alturaFramebuffer);
+    definirViewport(0, 0, larguraFramebuffer, alturaFramebuffer);
+
+    // Compilando e buildando os programas de shader: o do jogo e o da ampliação da cena para a janela
+    vector<GLuint> programas = criarProgramas({{vertexShaderSource, fragmentShaderSource},
+                                               {vertexAmpliacaoSource, fragmentAmpliacaoSource},
+                                               {vertexParallaxSource, fragmentParallaxSource},
+                                               {vertexShaderSource, fragmentOpacoSource.c_str()}});
+    GLuint shaderID = programas[0];
+    alvoCena.programaAmpliacao = programas[1];
+    parallax.programa = programas[2];
+    shaderOpaco = programas[3];
+
+    // Carregando as texturas: do pacote pré-processado, se existir, ou decodificadas em segundo plano
+    abrirPacoteTexturas(resolverCaminho("assets/texturas.pack"));
+    string tilesetPath = std::string("assets/tilesets/") + TILESET_FILENAME;
+
+    // Animações: a folha e o layout do principal vêm de Animacoes.txt
+    carregarAnimacoesTxt("src/ExemplosMoodle/M6_Material/Animacoes.txt");
+    int clipPrincipal = buscarClip("principal_1");
+    if (clipPrincipal < 0)
+    {
+        cerr << "Clip principal_1 não encontrado em Animacoes.txt\n";
+        return -1;
+    }
 
-    GLuint principalTexID = loadTexture("../assets/sprites/Vampires1_Walk_full.png", imgWidth, imgHeight);
     // Gerando um buffer simples, com a geometria de um triângulo
     principal.isAnimated = true;
-    principal.nAnimations = 4;
-	principal.nFrames = 6;
+    principal.nAnimations = clips[clipPrincipal].nLinhas;
+	principal.nFrames = clips[clipPrincipal].framesPorLinha;
 	principal.VAO = setupSprite(principal.nAnimations, principal.nFrames, principal.ds, principal.dt);
     principal.position = vec3(400.0, 150.0, 0.0);
     principal.dimensions = vec3(75, 75, 1.0);
-    principal.texID = principalTexID;
+    trocarTextura(principal.textura, "assets/sprites/" + clips[clipPrincipal].folha);
     principal.iAnimation = 1;
 	principal.iFrame = 0;
+    principal.clipID = clipPrincipal;
+    principal.tempoInicio = 0.0;
+
+    // Um clip por direção: principal_<iAnimation>
+    clipsDirecao.assign(principal.nAnimations + 1, clipPrincipal);
+    for (int i = 1; i <= principal.nAnimations; i++)
+    {
+        int clip = buscarClip("principal_" + to_string(i));
+        if (clip >= 0)
+            clipsDirecao[i] = clip;
+    }
 
-    string coinPath = std::string("../assets/sprites/") + COIN_FILENAME;
-    GLuint cointTexID = loadTexture(coinPath, imgWidth, imgHeight);
+    string coinPath = std::string("assets/sprites/") + COIN_FILENAME;
     // Gerando um buffer simples, com a geometria de um triângulo
     coin.isAnimated = false;
     coin.nAnimations = 1;
@@ -325,7 +4962,8 @@ int main()
     coin.VAO = setupSprite(1, 1, coin.ds, coin.dt);
     coin.position = vec3(0.0, 0.0, 0.0);
     coin.dimensions = vec3(COIN_HEIGHT, COIN_WIDTH, 1.0);
-    coin.texID = cointTexID;
+    trocarTextura(coin.textura, coinPath);
+    coin.clipID = registrarClip({"moeda", COIN_FILENAME, 1, 1, 0, 1, 0.0f, ANIMACAO_LOOP, 0});
 
     // Configura o tileset - conjunto de tiles do mapa
     for (int i = 0; i < QTD_TILE; i++)
@@ -333,12 +4971,15 @@ int main()
         Tile tile;
         tile.dimensions = vec3(TILE_HEIGHT, TILE_WIDTH, 1.0);
         tile.iTile = i;
-        tile.texID = texID;
+        trocarTextura(tile.textura, tilesetPath);
         tile.VAO = setupTile(QTD_TILE, tile.ds, tile.dt);
         tileset.push_back(tile);
     }
 
-    glUseProgram(shaderID); // Reseta o estado do shader para evitar problemas futuros
+    enviarTabelasAnimacao(shaderID);
+    criarTabelaContornos(shaderID);
+
+    usarPrograma(shaderID); // Reseta o estado do shader para evitar problemas futuros
 
     double prev_s = glfwGetTime();  // Define o "tempo anterior" inicial.
     double title_countdown_s = 0.1; // Intervalo para atualizar o título da janela com o FPS.
@@ -346,28 +4987,45 @@ int main()
     float colorValue = 0.0;
 
     // Ativando o primeiro buffer de textura do OpenGL
-    glActiveTexture(GL_TEXTURE0);
+    ativarUnidadeTextura(0);
 
     // Criando a variável uniform pra mandar a textura pro shader
-    glUniform1i(glGetUniformLocation(shaderID, "tex_buff"), 0);
+    uniform1i(shaderID, "tex_buff", 0);
+    uniform4f(shaderID, "tint", 1.0f, 1.0f, 1.0f, 1.0f);
+
+    // A variante sem recorte lê as mesmas unidades de textura
+    uniform1i(shaderOpaco, "tex_buff", 0);
+    uniform1i(shaderOpaco, "tabelaClips", 1);
+    uniform1i(shaderOpaco, "tabelaFrames", 2);
+    uniform1i(shaderOpaco, "tabelaContornos", 3);
+    uniform4f(shaderOpaco, "tint", 1.0f, 1.0f, 1.0f, 1.0f);
 
-    // Matriz de projeção paralela ortográfica
-    mat4 projection = ortho(0.0, 1200.0, 0.0, 800.0, -1.0, 1.0);
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "projection"), 1, GL_FALSE, value_ptr(projection));
+    iniciarTemporizadorGPU(caminhoCsvTempos);
 
-    glEnable(GL_DEPTH_TEST); // Habilita o teste de profundidade
-    glDepthFunc(GL_ALWAYS);  // Testa a cada ciclo
+    // Matriz de projeção paralela ortográfica (câmera) e alvo da cena, do tamanho atual da janela
+    aplicarRedimensionamento(shaderID, true);
+    criarParallax();
 
-    glEnable(GL_BLEND);                                // Habilita a transparência -- canal alpha
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // Seta função de transparência
+    habilitarGL(GL_DEPTH_TEST, true); // Habilita o teste de profundidade
+    funcaoDepth(GL_LEQUAL);           // z vem da camada e da diagonal isométrica (profundidadeIso)
+    uniform1f(shaderID, "alfaMinimo", ALFA_RECORTE);
 
-    double lastTime = 0.0;
-    double deltaT = 0.0;
-    double currTime = glfwGetTime();
-    double FPS = 12.0;
+    habilitarGL(GL_BLEND, true);                       // Habilita a transparência -- canal alpha
+    funcaoBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // Seta função de transparência
+
+    shaderJogo = shaderID;
+    tempoBase = glfwGetTime();
 
     map[selectedTileMapLine - 1][selectedTileMapColumn - 1] = WALKED_TILE;
 
+    zobrist = criarTabelaZobrist(TILEMAP_WIDTH * TILEMAP_HEIGHT);
+    hashEstado = calcularHashCompleto(zobrist, [](int i, int j) { return map[i][j]; }, TILEMAP_HEIGHT,
+                                      TILEMAP_WIDTH, selectedTileMapLine, selectedTileMapColumn, coin.isCollect);
+
+    criarHistorico(historico, TILEMAP_WIDTH * TILEMAP_HEIGHT);
+    gravarSnapshotDoJogo();
+    proximoTick = glfwGetTime() + 1.0 / TICKS_POR_SEGUNDO;
+
     std::cout << "Bem vindo!" << std::endl;
     std::cout << "O objetivo deste jogo é coletar a moeda e chegar ao tile preto, nessa ordem" << std::endl;
     std::cout << "Cuidado! Você pode morrer na lava!" << std::endl;
@@ -375,206 +5033,208 @@ int main()
     // Loop da aplicação - "game loop"
     while (!glfwWindowShouldClose(window))
     {
-        // Checa se houveram eventos de input (key pressed, mouse moved etc.) e chama as funções de callback correspondentes
-        glfwPollEvents();
+        // Checa se houveram eventos de input (key pressed, mouse moved etc.) e chama as funções de callback
+        // correspondentes; se não houver nada para desenhar, espera por eles até o próximo prazo
+        aguardarProximoQuadro();
+
+        PERFIL_ZONA("quadro");
+        double curr_s = glfwGetTime();
 
         if (!principal.isAlive)
         {
             std::cout << "Você morreu!" << std::endl;
+            liberarTexturasCena();
             glfwTerminate();
             return 0;
         }
 
-        // Limpa o buffer de cor
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // cor de fundo
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glLineWidth(10);
-        glPointSize(20);
-
-        // Desenhar o mapa
-        desenharMapa(shaderID);
-
-        //---------------------------------------------------------------------
-        // Desenho do principal
-        // Matriz de transformaçao do objeto - Matriz de modelo
-        mat4 model = mat4(1); // matriz identidade
-
-        vec2 offsetTex;
+        // Um snapshot por tick para o rewind
+        gravarTicksVencidos();
 
-        currTime = glfwGetTime();
-		deltaT = currTime - lastTime;
+        // Texturas que terminaram de decodificar no pool de threads
+        processarTexturasProntas(0.004);
+        processarPaginasFundo();
 
-		if (principal.isAnimated) {
-            if (deltaT >= 1.0 / FPS)
-		    {
-		    	principal.iFrame = (principal.iFrame + 1) % principal.nFrames; // incremento "circular"
-		    	lastTime = currTime;
-		    }
+        if (!deveDesenhar(glfwGetTime()))
+            continue;
 
-		    offsetTex.s = principal.iFrame * principal.ds;
-		    offsetTex.t = (principal.iAnimation) * principal.dt;
-		    glUniform2f(glGetUniformLocation(shaderID, "offsetTex"), offsetTex.s, offsetTex.t);
+        // Tempo entre quadros desenhados: atualiza o FPS no título
+        double elapsed_s = curr_s - prev_s;
+        prev_s = curr_s;
+        title_countdown_s -= elapsed_s;
+        if (title_countdown_s <= 0.0 && elapsed_s > 0.0)
+        {
+            char titulo[160];
+            const EstatisticaTempo &gpu = temporizadorGPU.passos[temporizadorGPU.passoQuadro];
+            snprintf(titulo, sizeof(titulo), "Atividade vivencial - M6 -- FPS %.1f (%.2f ms, GPU %.2f ms%s)", 1.0 / elapsed_s,
+                     elapsed_s * 1000.0, gpu.percentil(0.5f), (resumoQuadroGL() + resumoDepuracao()).c_str());
+            glfwSetWindowTitle(window, titulo);
+            title_countdown_s = 0.1;
         }
 
-        float tile_iso_width = tileset[0].dimensions.x;
-        float tile_iso_height = tileset[0].dimensions.y;
-
-        float x0 = 615;
-        float y0 = 100;
-
-        float x = x0 + (selectedTileMapColumn - selectedTileMapLine) * (tile_iso_width / 2.0f);
-        float y = (y0 + (selectedTileMapLine + selectedTileMapColumn) * (tile_iso_height / 2.0f)) + (tile_iso_height / 2.0f) - (principal.dimensions.y / 2.0f);
-
-        vec3 position = vec3(x, y, 0.0);
-
-        model = translate(model, position);
-        model = rotate(model, radians(0.0f), vec3(0.0, 0.0, 1.0));
-        model = scale(model, principal.dimensions);
-        glUniformMatrix4fv(glGetUniformLocation(shaderID, "model"), 1, GL_FALSE, value_ptr(model));
-
-        glBindVertexArray(principal.VAO);              // Conectando ao buffer de geometria
-        glBindTexture(GL_TEXTURE_2D, principal.texID); // Conectando ao buffer de textura
-
-        // Chamada de desenho - drawcall
-        // Poligono Preenchido - GL_TRIANGLES
-        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        //---------------------------------------------------------------------------
-
-        //---------------------------------------------------------------------
-        // Desenho da coin
-        // Matriz de transformaçao do objeto - Matriz de modelo
-        
-        
-        if (!coin.isCollect) {
-
-        	glUniform2f(glGetUniformLocation(shaderID, "offsetTex"), 1, 1);
+        desenharQuadro(window);
 
-            model = mat4(1); // matriz identidade
-
-            float x0Coin = 615;
-            float y0Coin = 80;
-
-            float xCoin = x0Coin + (COIN_COLUMN - COIN_LINE) * (tile_iso_width / 2.0f);
-            float yCoin = (y0Coin + (COIN_LINE + COIN_COLUMN) * (tile_iso_height / 2.0f)) + (tile_iso_height / 2.0f) - (coin.dimensions.y / 2.0f);
-
-            vec3 positionCoin = vec3(xCoin, yCoin, 0.0);
-
-            model = translate(model, positionCoin);
-            model = rotate(model, radians(0.0f), vec3(0.0, 0.0, 1.0));
-            model = scale(model, coin.dimensions);
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "model"), 1, GL_FALSE, value_ptr(model));
-
-            glBindVertexArray(coin.VAO);              // Conectando ao buffer de geometria
-            glBindTexture(GL_TEXTURE_2D, coin.texID); // Conectando ao buffer de textura
-
-            // Chamada de desenho - drawcall
-            // Poligono Preenchido - GL_TRIANGLES
-            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        // Exporta o perfil quando o trabalho de um quadro (sem contar a espera por eventos) trava
+        double duracao_s = glfwGetTime() - curr_s;
+        static double ultimaExportacaoTravamento = -1e9;
+        if (duracao_s > LIMIAR_TRAVAMENTO_S && curr_s - ultimaExportacaoTravamento > 5.0 && curr_s - tempoBase > 1.0)
+        {
+#ifdef PERFIL_CPU
+            exportarPerfil("quadro lento");
+#endif
+            ultimaExportacaoTravamento = curr_s;
         }
-        //---------------------------------------------------------------------------
-
-        // Troca os buffers da tela
-        glfwSwapBuffers(window);
     }
 
     // Finaliza a execução da GLFW, limpando os recursos alocados por ela
+    liberarTexturasCena();
     glfwTerminate();
     return 0;
 }
 
+// Desenha e apresenta um quadro; chamado pelo loop principal e pelo callback de refresh da janela
+void desenharQuadro(GLFWwindow *window)
+{
+    if (shaderJogo == 0)
+        return; // ainda inicializando
+    PERFIL_ZONA("desenharQuadro");
+    GLuint shaderID = shaderJogo;
+    double inicio = glfwGetTime();
+
+    aplicarRedimensionamento(shaderID, false);
+    iniciarQuadroGPU();
+
+    // A cena é desenhada no alvo de baixa resolução
+    vincularAlvoCena();
+    usarPrograma(shaderID);
+    iniciarQuadroDepuracao(shaderID);
+
+    // Limpa o buffer de cor
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // cor de fundo
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glLineWidth(10);
+    glPointSize(20);
+
+    // Único valor de animação enviado por quadro; os frames são escolhidos no vertex shader
+    double tempoAnimacao = glfwGetTime() - tempoBase;
+    uniform1f(shaderOpaco, "tempo", (float)tempoAnimacao);
+    uniform1f(shaderID, "tempo", (float)tempoAnimacao);
+
+    // Sprites opacos, depois o fundo e o mapa (o chão, atrás dos sprites) e por fim os sprites translúcidos
+    desenharObjetos(shaderID, true);
+    desenharParallax();
+    uniform1i(shaderOpaco, "clipID", -1);
+    uniform1i(shaderID, "clipID", -1);
+    usarPrograma(shaderID);
+    desenharMapa(shaderID);
+    desenharObjetos(shaderID, false);
+    desenharOverlayTempos(shaderID);
+
+    apresentarCena();
+
+    terminarQuadroGPU(glfwGetTime() - inicio);
+    fecharQuadroGL();
+    atualizarResolucaoDinamica();
+
+    // Troca os buffers da tela
+    glfwSwapBuffers(window);
+    quadroDesenhado(glfwGetTime(), tempoAnimacao);
+}
+
 // Função de callback de teclado - só pode ter uma instância (deve ser estática se
 // estiver dentro de uma classe) - É chamada sempre que uma tecla for pressionada
 // ou solta via GLFW
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode)
 {
-    int possibleTileMapLine = selectedTileMapLine;
-    int possibleTileMapColumn = selectedTileMapColumn;
+    PERFIL_ZONA("key_callback");
+    gravarTicksVencidos(); // os ticks que passaram enquanto o loop dormia são anteriores a esta tecla
+    marcarQuadroSujo();
+
+    if (key == GLFW_KEY_BACKSPACE && action == GLFW_PRESS)
+    {
+        voltarNoTempo(SEGUNDOS_REWIND);
+        return;
+    }
+
+    if (key == GLFW_KEY_F1 && action == GLFW_PRESS)
+    {
+        relatorioTexturas();
+        return;
+    }
+
+    if (key == GLFW_KEY_F2 && action == GLFW_PRESS)
+    {
+        exportarPerfil("F2");
+        return;
+    }
+
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS)
+    {
+        temporizadorGPU.overlay = !temporizadorGPU.overlay;
+        relatorioTemposGPU();
+        return;
+    }
+
+    if (key == GLFW_KEY_F4 && action == GLFW_PRESS)
+    {
+        relatorioChamadasGL();
+        return;
+    }
+
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS)
+    {
+        alternarModoDepuracao();
+        return;
+    }
 
     if (action == GLFW_PRESS || action == GLFW_REPEAT)
     {
-        if (key == GLFW_KEY_A)
-        {
-            possibleTileMapLine += 1;
-            possibleTileMapColumn -= 1;
-            principal.iAnimation = 3;
-        }
-        if (key == GLFW_KEY_D)
+        int dLinha = 0, dColuna = 0;
+        for (int m = 0; m < NUM_MOVIMENTOS; m++)
         {
-            possibleTileMapLine -= 1;
-            possibleTileMapColumn += 1;
-            principal.iAnimation = 4;
-			
+            if (key == TECLAS_MOVIMENTO[m])
+            {
+                dLinha = MOVIMENTOS[m][0];
+                dColuna = MOVIMENTOS[m][1];
+                principal.iAnimation = MOVIMENTOS[m][2];
+            }
         }
 
-        if (key == GLFW_KEY_W)
-        {
-            possibleTileMapLine += 1;
-            possibleTileMapColumn += 1;
-            principal.iAnimation = 2;
-			
-        }
-        if (key == GLFW_KEY_S)
-        {
-            possibleTileMapLine -= 1;
-            possibleTileMapColumn -= 1;
-            principal.iAnimation = 1;
-			
-        }
-        if (key == GLFW_KEY_E)
-        {
-            possibleTileMapColumn += 1;
-            principal.iAnimation = 4;
-			
-        }
-        if (key == GLFW_KEY_Q)
-        {
-            possibleTileMapLine += 1;
-            principal.iAnimation = 3;
-			
-        }
-        if (key == GLFW_KEY_C)
-        {
-            possibleTileMapLine -= 1;
-            principal.iAnimation = 4;
-			
-        }
-        if (key == GLFW_KEY_Z)
-        {
-            possibleTileMapColumn -= 1;
-            principal.iAnimation = 3;
-			
-        }
+        int posicaoAntes = (selectedTileMapLine - 1) * TILEMAP_WIDTH + (selectedTileMapColumn - 1);
+        bool moedaAntes = coin.isCollect;
+        AlteracaoCelula alteracao;
 
-        possibleTileMapLine = glm::clamp(possibleTileMapLine, 1, TILEMAP_HEIGHT);
-        possibleTileMapColumn = glm::clamp(possibleTileMapColumn, 1, TILEMAP_WIDTH);
+        int eventos = aplicarRegrasMovimento(modeloMapa, [](int i, int j) -> int & { return map[i][j]; },
+                                             selectedTileMapLine, selectedTileMapColumn, coin.isCollect,
+                                             dLinha, dColuna, &alteracao);
 
-        if (!isTileInArray(map[possibleTileMapLine - 1][possibleTileMapColumn - 1], NOT_WALKABLE_TILES))
-        {
-            selectedTileMapLine = possibleTileMapLine;
-            selectedTileMapColumn = possibleTileMapColumn;
-        }
+        hashEstado = atualizarHash(hashEstado, zobrist, posicaoAntes,
+                                   (selectedTileMapLine - 1) * TILEMAP_WIDTH + (selectedTileMapColumn - 1),
+                                   moedaAntes, coin.isCollect, alteracao);
+        if (alteracao.indice >= 0)
+            historico.pendentes.push_back(alteracao);
+        assert(hashEstado == calcularHashCompleto(zobrist, [](int i, int j) { return map[i][j]; },
+                                                  TILEMAP_HEIGHT, TILEMAP_WIDTH, selectedTileMapLine,
+                                                  selectedTileMapColumn, coin.isCollect));
 
-        if (isTileInArray(map[selectedTileMapLine - 1][selectedTileMapColumn - 1], DANGEROUS_TILES))
+        if (eventos & EVENTO_MORTE)
         {
             principal.isAlive = false;
         }
 
-        if (selectedTileMapColumn == COIN_COLUMN && selectedTileMapLine == COIN_LINE && !coin.isCollect)
+        if (eventos & EVENTO_MOEDA)
         {
-            coin.isCollect = true;
             std::cout << "Você coletou a moeda, vá para o tile preto!" << std::endl;
         }
 
-        if (map[selectedTileMapLine - 1][selectedTileMapColumn - 1] == FINAL_TITLE)
+        if (eventos & EVENTO_FINAL)
         {
-            if (coin.isCollect) {
-                finalizarJogo();
-            } else {
-                std::cout << "Você precisa coletar a moeda antes de chegar ao tile preto!" << std::endl;
-            }
-        } else {
-            map[selectedTileMapLine - 1][selectedTileMapColumn - 1] = WALKED_TILE;
+            finalizarJogo();
+        }
+        else if (eventos & EVENTO_FINAL_SEM_MOEDA)
+        {
+            std::cout << "Você precisa coletar a moeda antes de chegar ao tile preto!" << std::endl;
         }
     }
 }
@@ -586,49 +5246,276 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 //  A função retorna o identificador do programa de shader
 int setupShader()
 {
-    // Vertex shader
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-    // Checando erros de compilação (exibição via log no terminal)
+    return criarProgramas({{vertexShaderSource, fragmentShaderSource}})[0];
+}
+
+// ================================
+// Cache de binários de programas de shader
+// ================================
+// Programas linkados são salvos com glGetProgramBinary em um arquivo cuja chave é o hash do
+// código fonte mais fabricante, renderer e versão do driver, e recarregados com glProgramBinary
+// nas execuções seguintes. Se o driver recusar o binário (atualização, outra GPU), o programa é
+// compilado de novo e o cache é regravado. Nas compilações, todos os programas que faltam são
+// disparados juntos; com KHR_parallel_shader_compile o driver os compila em paralelo.
+// Essas funções são da OpenGL 4.1 / extensões, fora do perfil 3.3 da GLAD, então os ponteiros
+// são obtidos à mão.
+
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+
+typedef void (APIENTRYP PFNGETPROGRAMBINARY)(GLuint, GLsizei, GLsizei *, GLenum *, void *);
+typedef void (APIENTRYP PFNPROGRAMBINARY)(GLuint, GLenum, const void *, GLsizei);
+typedef void (APIENTRYP PFNPROGRAMPARAMETERI)(GLuint, GLenum, GLint);
+typedef void (APIENTRYP PFNMAXSHADERCOMPILERTHREADS)(GLuint);
+
+PFNGETPROGRAMBINARY pGetProgramBinary = nullptr;
+PFNPROGRAMBINARY pProgramBinary = nullptr;
+PFNPROGRAMPARAMETERI pProgramParameteri = nullptr;
+bool compilacaoParalela = false;
+
+const char MAGIA_BINARIO_SHADER[4] = {'P', 'G', 'S', 'B'};
+
+void carregarFuncoesBinarioShader()
+{
+    static bool carregadas = false;
+    if (carregadas)
+        return;
+    carregadas = true;
+
+    GLint nFormatos = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormatos);
+    glGetError(); // enum desconhecido em drivers antigos
+    if (nFormatos > 0)
+    {
+        pGetProgramBinary = (PFNGETPROGRAMBINARY)glfwGetProcAddress("glGetProgramBinary");
+        pProgramBinary = (PFNPROGRAMBINARY)glfwGetProcAddress("glProgramBinary");
+        pProgramParameteri = (PFNPROGRAMPARAMETERI)glfwGetProcAddress("glProgramParameteri");
+    }
+
+    PFNMAXSHADERCOMPILERTHREADS maxThreads = nullptr;
+    if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+        maxThreads = (PFNMAXSHADERCOMPILERTHREADS)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+        maxThreads = (PFNMAXSHADERCOMPILERTHREADS)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    if (maxThreads)
+    {
+        maxThreads(0xFFFFFFFFu); // o driver escolhe quantas threads usar
+        compilacaoParalela = true;
+    }
+}
+
+// Pasta de cache do usuário (%LOCALAPPDATA% ou XDG_CACHE_HOME/~/.cache), nunca a pasta temporária
+// compartilhada: o driver interpreta o que estiver lá, e outro usuário poderia plantar um arquivo. Vazia se
+// não houver pasta segura; nesse caso os shaders são sempre compilados.
+string pastaCacheShaders()
+{
+    static string pasta = [] {
+        filesystem::path base;
+#ifdef _WIN32
+        if (const char *localAppData = getenv("LOCALAPPDATA"))
+            base = localAppData;
+#else
+        if (const char *xdg = getenv("XDG_CACHE_HOME"); xdg && xdg[0] == '/')
+            base = xdg;
+        else if (const char *home = getenv("HOME"); home && home[0] == '/')
+            base = filesystem::path(home) / ".cache";
+#endif
+        if (base.empty())
+            return string();
+
+        filesystem::path caminho = base / "pgcchib" / "shader_cache";
+        error_code erro;
+        filesystem::create_directories(caminho, erro);
+        filesystem::permissions(caminho, filesystem::perms::owner_all, filesystem::perm_options::replace, erro);
+#ifndef _WIN32
+        // Só usa a pasta se for nossa e ninguém mais puder escrever nela
+        struct stat info;
+        if (stat(caminho.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != getuid()
+            || (info.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+            return string();
+#endif
+        return filesystem::is_directory(caminho, erro) ? caminho.string() : string();
+    }();
+    return pasta;
+}
+
+string caminhoBinarioShader(uint64_t chave)
+{
+    if (pastaCacheShaders().empty())
+        return string();
+    char nome[32];
+    snprintf(nome, sizeof(nome), "%016llx.bin", (unsigned long long)chave);
+    return (filesystem::path(pastaCacheShaders()) / nome).string();
+}
+
+uint64_t chaveBinarioShader(const FontesPrograma &fontes)
+{
+    string texto = string(fontes.vertex) + '\0' + fontes.fragment + '\0'
+                 + (const char *)glGetString(GL_VENDOR) + '\0' + (const char *)glGetString(GL_RENDERER) + '\0'
+                 + (const char *)glGetString(GL_VERSION);
+    return hashNome(texto.data(), texto.size(), 0);
+}
+
+bool carregarBinarioShader(GLuint programa, uint64_t chave)
+{
+    if (!pProgramBinary)
+        return false;
+
+    string caminho = caminhoBinarioShader(chave);
+    if (caminho.empty())
+        return false;
+    ifstream arquivo(caminho, ios::binary);
+    if (!arquivo.is_open())
+        return false;
+
+    char magia[4];
+    uint64_t chaveArquivo = 0;
+    uint32_t formato = 0, tamanho = 0;
+    arquivo.read(magia, 4);
+    arquivo.read((char *)&chaveArquivo, sizeof(chaveArquivo));
+    arquivo.read((char *)&formato, sizeof(formato));
+    arquivo.read((char *)&tamanho, sizeof(tamanho));
+    if (!arquivo || memcmp(magia, MAGIA_BINARIO_SHADER, 4) != 0 || chaveArquivo != chave)
+        return false;
+
+    vector<char> binario(tamanho);
+    arquivo.read(binario.data(), tamanho);
+    if (!arquivo)
+        return false;
+
+    pProgramBinary(programa, formato, binario.data(), (GLsizei)tamanho);
+    GLint success = 0;
+    glGetProgramiv(programa, GL_LINK_STATUS, &success);
+    return success != 0;
+}
+
+void salvarBinarioShader(GLuint programa, uint64_t chave)
+{
+    if (!pGetProgramBinary)
+        return;
+
+    GLint tamanho = 0;
+    glGetProgramiv(programa, GL_PROGRAM_BINARY_LENGTH, &tamanho);
+    if (tamanho <= 0)
+        return;
+    vector<char> binario(tamanho);
+    GLenum formato = 0;
+    pGetProgramBinary(programa, tamanho, nullptr, &formato, binario.data());
+
+    string caminho = caminhoBinarioShader(chave);
+    if (caminho.empty())
+        return;
+    ofstream arquivo(caminho, ios::binary);
+    if (!arquivo.is_open())
+        return;
+    uint32_t formato32 = formato, tamanho32 = (uint32_t)tamanho;
+    arquivo.write(MAGIA_BINARIO_SHADER, 4);
+    arquivo.write((const char *)&chave, sizeof(chave));
+    arquivo.write((const char *)&formato32, sizeof(formato32));
+    arquivo.write((const char *)&tamanho32, sizeof(tamanho32));
+    arquivo.write(binario.data(), tamanho);
+}
+
+GLuint criarShader(GLenum tipo, const GLchar *fonte)
+{
+    GLuint shader = glCreateShader(tipo);
+    glShaderSource(shader, 1, &fonte, NULL);
+    glCompileShader(shader);
+    return shader;
+}
+
+// Checando erros de compilação (exibição via log no terminal)
+void verificarShader(GLuint shader, const char *nome)
+{
     GLint success;
     GLchar infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success)
     {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n"
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cout << "ERROR::SHADER::" << nome << "::COMPILATION_FAILED\n"
                   << infoLog << std::endl;
     }
-    // Fragment shader
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    // Checando erros de compilação (exibição via log no terminal)
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
+}
+
+vector<GLuint> criarProgramas(const vector<FontesPrograma> &fontes)
+{
+    carregarFuncoesBinarioShader();
+
+    vector<GLuint> programas(fontes.size());
+    vector<uint64_t> chaves(fontes.size());
+    vector<size_t> compilar;
+
+    for (size_t i = 0; i < fontes.size(); i++)
     {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n"
-                  << infoLog << std::endl;
+        programas[i] = glCreateProgram();
+        chaves[i] = chaveBinarioShader(fontes[i]);
+        if (!carregarBinarioShader(programas[i], chaves[i]))
+            compilar.push_back(i);
     }
-    // Linkando os shaders e criando o identificador do programa de shader
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    // Checando por erros de linkagem
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
+
+    if (compilar.empty())
+        return programas;
+
+    // Dispara todas as compilações e linkagens antes de consultar qualquer resultado,
+    // para que o driver possa trabalhar nelas em paralelo
+    vector<GLuint> vertexShaders, fragmentShaders;
+    for (size_t i : compilar)
     {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
-                  << infoLog << std::endl;
+        if (pProgramParameteri)
+            pProgramParameteri(programas[i], GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        vertexShaders.push_back(criarShader(GL_VERTEX_SHADER, fontes[i].vertex));
+        fragmentShaders.push_back(criarShader(GL_FRAGMENT_SHADER, fontes[i].fragment));
+    }
+    for (size_t k = 0; k < compilar.size(); k++)
+    {
+        // Linkando os shaders e criando o identificador do programa de shader
+        glAttachShader(programas[compilar[k]], vertexShaders[k]);
+        glAttachShader(programas[compilar[k]], fragmentShaders[k]);
+        glLinkProgram(programas[compilar[k]]);
+    }
+
+    if (compilacaoParalela)
+    {
+        for (size_t k = 0; k < compilar.size(); k++)
+        {
+            GLint pronto = GL_FALSE;
+            while (!pronto)
+            {
+                glGetProgramiv(programas[compilar[k]], GL_COMPLETION_STATUS_KHR, &pronto);
+                if (!pronto)
+                    std::this_thread::yield();
+            }
+        }
+    }
+
+    for (size_t k = 0; k < compilar.size(); k++)
+    {
+        GLuint programa = programas[compilar[k]];
+        verificarShader(vertexShaders[k], "VERTEX");
+        verificarShader(fragmentShaders[k], "FRAGMENT");
+
+        // Checando por erros de linkagem
+        GLint success;
+        GLchar infoLog[512];
+        glGetProgramiv(programa, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(programa, 512, NULL, infoLog);
+            std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n"
+                      << infoLog << std::endl;
+        }
+        else
+        {
+            salvarBinarioShader(programa, chaves[compilar[k]]);
+        }
+        glDeleteShader(vertexShaders[k]);
+        glDeleteShader(fragmentShaders[k]);
     }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
 
-    return shaderProgram;
+    return programas;
 }
 
 // Esta função está bastante harcoded - objetivo é criar os buffers que armazenam a
@@ -654,7 +5541,7 @@ int setupSprite(int nAnimations, int nFrames, float &ds, float &dt)
 	// Geração do identificador do VBO
 	glGenBuffers(1, &VBO);
 	// Faz a conexão (vincula) do buffer como um buffer de array
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	vincularBuffer(GL_ARRAY_BUFFER, VBO);
 	// Envia os dados do array de floats para o buffer da OpenGl
 	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
@@ -662,7 +5549,7 @@ int setupSprite(int nAnimations, int nFrames, float &ds, float &dt)
 	glGenVertexArrays(1, &VAO);
 	// Vincula (bind) o VAO primeiro, e em seguida  conecta e seta o(s) buffer(s) de vértices
 	// e os ponteiros para os atributos
-	glBindVertexArray(VAO);
+	vincularVAO(VAO);
 	// Para cada atributo do vertice, criamos um "AttribPointer" (ponteiro para o atributo), indicando:
 	//  Localização no shader * (a localização dos atributos devem ser correspondentes no layout especificado no vertex shader)
 	//  Numero de valores que o atributo tem (por ex, 3 coordenadas xyz)
@@ -681,10 +5568,10 @@ int setupSprite(int nAnimations, int nFrames, float &ds, float &dt)
 
 	// Observe que isso é permitido, a chamada para glVertexAttribPointer registrou o VBO como o objeto de buffer de vértice
 	// atualmente vinculado - para que depois possamos desvincular com segurança
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	vincularBuffer(GL_ARRAY_BUFFER, 0);
 
 	// Desvincula o VAO (é uma boa prática desvincular qualquer buffer ou array para evitar bugs medonhos)
-	glBindVertexArray(0);
+	vincularVAO(0);
 
 	return VAO;
 }
@@ -710,7 +5597,7 @@ int setupTile(int nTiles, float &ds, float &dt)
     // Geração do identificador do VBO
     glGenBuffers(1, &VBO);
     // Faz a conexão (vincula) do buffer como um buffer de array
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    vincularBuffer(GL_ARRAY_BUFFER, VBO);
     // Envia os dados do array de floats para o buffer da OpenGl
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
@@ -718,7 +5605,7 @@ int setupTile(int nTiles, float &ds, float &dt)
     glGenVertexArrays(1, &VAO);
     // Vincula (bind) o VAO primeiro, e em seguida  conecta e seta o(s) buffer(s) de vértices
     // e os ponteiros para os atributos
-    glBindVertexArray(VAO);
+    vincularVAO(VAO);
     // Para cada atributo do vertice, criamos um "AttribPointer" (ponteiro para o atributo), indicando:
     //  Localização no shader * (a localização dos atributos devem ser correspondentes no layout especificado no vertex shader)
     //  Numero de valores que o atributo tem (por ex, 3 coordenadas xyz)
@@ -737,95 +5624,384 @@ int setupTile(int nTiles, float &ds, float &dt)
 
     // Observe que isso é permitido, a chamada para glVertexAttribPointer registrou o VBO como o objeto de buffer de vértice
     // atualmente vinculado - para que depois possamos desvincular com segurança
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    vincularBuffer(GL_ARRAY_BUFFER, 0);
 
     // Desvincula o VAO (é uma boa prática desvincular qualquer buffer ou array para evitar bugs medonhos)
-    glBindVertexArray(0);
+    vincularVAO(0);
 
     return VAO;
 }
 
-int loadTexture(string filePath, int &width, int &height)
+// ================================
+// Cache do mapa em textura
+// ================================
+// O mapa é desenhado uma vez em uma textura do tamanho do mundo (FBO) e, a cada quadro, vai para a
+// tela com um único quad. O cache guarda o valor de cada célula que foi desenhada; quando o mapa muda
+// (passo do personagem, rewind, mapa novo), só o retângulo das células alteradas é limpo e redesenhado,
+// com scissor, junto com os vizinhos que encostam nele. As cores ficam pré-multiplicadas pelo alfa,
+// então a composição dá o mesmo resultado que desenhar os tiles direto na tela.
+
+const int MAX_CELULAS_REDESENHO_PARCIAL = 32; // acima disso redesenha o mapa todo
+
+struct CacheMapa
 {
-    GLuint texID;
+    GLuint fbo = 0;
+    GLuint textura = 0;
+    GLuint profundidade = 0; // renderbuffer de depth: os tiles podem ser desenhados em qualquer ordem
+    GLuint vaoQuad = 0;
+    vector<int> desenhado; // valor de cada célula quando foi desenhada
+    bool tudoSujo = true;
+    bool semTranslucidos = false; // só tiles opacos e recortes: o alfa do cache é 0 ou 1
+};
 
-    // Gera o identificador da textura na memória
-    glGenTextures(1, &texID);
-    glBindTexture(GL_TEXTURE_2D, texID);
+CacheMapa cacheMapa;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+void invalidarCacheMapa()
+{
+    cacheMapa.tudoSujo = true;
+}
+
+// Posição (canto inferior esquerdo) do tile (i, j) em coordenadas do mundo
+vec2 posicaoTile(int i, int j)
+{
+    // dá pra fazer um cálculo usando tilemap_width e tilemap_height
+    float x0 = 575;
+    float y0 = 100;
+    const Tile &tile = tileset[map[i][j]];
+    return vec2(x0 + (j - i) * tile.dimensions.x / 2.0, y0 + (j + i) * tile.dimensions.y / 2.0);
+}
 
+void criarCacheMapa()
+{
+    glGenTextures(1, &cacheMapa.textura);
+    vincularTextura(0, GL_TEXTURE_2D, cacheMapa.textura);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, LARGURA_MUNDO, ALTURA_MUNDO, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenRenderbuffers(1, &cacheMapa.profundidade);
+    vincularRenderbuffer(cacheMapa.profundidade);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, LARGURA_MUNDO, ALTURA_MUNDO);
+    vincularRenderbuffer(0);
+
+    glGenFramebuffers(1, &cacheMapa.fbo);
+    vincularFramebuffer(cacheMapa.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cacheMapa.textura, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, cacheMapa.profundidade);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        cerr << "Framebuffer do cache do mapa incompleto" << endl;
+        exit(1);
+    }
+    vincularFramebuffer(0);
 
-    int nrChannels;
-
-    unsigned char *data = stbi_load(filePath.c_str(), &width, &height, &nrChannels, 0);
+    float ds, dt;
+    cacheMapa.vaoQuad = setupSprite(1, 1, ds, dt);
+}
 
-    if (data)
+// Desenha os tiles cujo retângulo encosta em recorte (x0, y0, x1, y1); nullptr desenha todos
+void desenharTiles(GLuint shaderID, const vec4 *recorte)
+{
+    // Com a profundidade, a ordem não muda o resultado: os opacos vêm primeiro, agrupados por textura e VAO
+    // para trocar menos estado e, dentro do grupo, da frente para trás; os translúcidos vêm depois, de trás
+    // para frente
+    static vector<int> celulas;
+    celulas.clear();
+    for (int i = 0; i < TILEMAP_HEIGHT; i++)
     {
-        if (nrChannels == 3) // jpg, bmp
+        for (int j = 0; j < TILEMAP_WIDTH; j++)
         {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+            const Tile &curr_tile = tileset[map[i][j]];
+            vec2 pos = posicaoTile(i, j);
+
+            if (recorte && (pos.x > recorte->z || pos.x + curr_tile.dimensions.x < recorte->x
+                            || pos.y > recorte->w || pos.y + curr_tile.dimensions.y < recorte->y))
+                continue;
+            opacidadeTile(tileset[map[i][j]]);
+            celulas.push_back(i * TILEMAP_WIDTH + j);
         }
-        else // png
+    }
+    std::stable_sort(celulas.begin(), celulas.end(), [](int a, int b) {
+        const Tile &ta = tileset[map[a / TILEMAP_WIDTH][a % TILEMAP_WIDTH]];
+        const Tile &tb = tileset[map[b / TILEMAP_WIDTH][b % TILEMAP_WIDTH]];
+        bool opacoA = passoOpaco(ta.opacidade), opacoB = passoOpaco(tb.opacidade);
+        int diagonalA = a / TILEMAP_WIDTH + a % TILEMAP_WIDTH, diagonalB = b / TILEMAP_WIDTH + b % TILEMAP_WIDTH;
+        if (opacoA != opacoB)
+            return opacoA;
+        if (!opacoA)
+            return diagonalA > diagonalB;
+        if (ta.textura != tb.textura)
+            return ta.textura < tb.textura;
+        return ta.VAO != tb.VAO ? ta.VAO < tb.VAO : diagonalA < diagonalB;
+    });
+
+    habilitarGL(GL_BLEND, false);
+    for (int celula : celulas)
+    {
+        int i = celula / TILEMAP_WIDTH, j = celula % TILEMAP_WIDTH;
+        const Tile &curr_tile = tileset[map[i][j]];
+        vec2 pos = posicaoTile(i, j);
+
+        if (!passoOpaco(curr_tile.opacidade))
         {
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            habilitarGL(GL_BLEND, true);
+            mascaraDepth(false);
         }
-        glGenerateMipmap(GL_TEXTURE_2D);
+
+        // Matriz de transformaçao do objeto - Matriz de modelo
+        mat4 model = mat4(1); // matriz identidade
+        model = translate(model, vec3(pos.x, pos.y, profundidadeIso(CAMADA_CHAO, (float)(i + j))));
+        model = scale(model, curr_tile.dimensions);
+        GLuint programa = programaParaOpacidade(shaderID, curr_tile.opacidade);
+        uniformMatrix4fv(programa, "model", value_ptr(model));
+
+        vec2 offsetTex;
+
+        offsetTex.s = curr_tile.iTile * curr_tile.ds;
+        offsetTex.t = 0.0;
+        uniform2f(programa, "offsetTex", offsetTex.s, offsetTex.t);
+
+        vincularVAO(curr_tile.VAO);                         // Conectando ao buffer de geometria
+        vincularTextura(0, GL_TEXTURE_2D, texturaGL(curr_tile.textura)); // Conectando ao buffer de textura
+
+        // Chamada de desenho - drawcall
+        // Poligono Preenchido - GL_TRIANGLES
+        usarPrograma(programa);
+        desenharArrays(programa, GL_TRIANGLE_STRIP, 4);
     }
-    else
+    usarPrograma(shaderID);
+    habilitarGL(GL_BLEND, true);
+    mascaraDepth(true);
+}
+
+// Redesenha no FBO o que mudou desde o último quadro
+void atualizarCacheMapa(GLuint shaderID)
+{
+    int nCelulas = TILEMAP_HEIGHT * TILEMAP_WIDTH;
+    if ((int)cacheMapa.desenhado.size() != nCelulas)
     {
-        std::cout << "Failed to load texture" << std::endl;
+        cacheMapa.desenhado.assign(nCelulas, -1);
+        cacheMapa.tudoSujo = true;
     }
 
-    stbi_image_free(data);
+    vector<vec4> recortes;
+    if (!cacheMapa.tudoSujo)
+    {
+        for (int i = 0; i < TILEMAP_HEIGHT; i++)
+        {
+            for (int j = 0; j < TILEMAP_WIDTH; j++)
+            {
+                if (cacheMapa.desenhado[i * TILEMAP_WIDTH + j] == map[i][j])
+                    continue;
+                const Tile &tile = tileset[map[i][j]];
+                vec2 pos = posicaoTile(i, j);
+                recortes.push_back(vec4(pos.x, pos.y, pos.x + tile.dimensions.x, pos.y + tile.dimensions.y));
+            }
+        }
+        if (recortes.empty())
+            return;
+        if ((int)recortes.size() > MAX_CELULAS_REDESENHO_PARCIAL)
+            cacheMapa.tudoSujo = true;
+    }
+
+    PERFIL_ZONA("atualizarCacheMapa");
+    if (cacheMapa.fbo == 0)
+        criarCacheMapa();
+
+    // O cache cobre o mundo inteiro, um texel por unidade, independente da câmera
+    mat4 projecaoMundo = ortho(0.0f, (float)LARGURA_MUNDO, 0.0f, (float)ALTURA_MUNDO, -1.0f, 1.0f);
+    vincularFramebuffer(cacheMapa.fbo);
+    definirViewport(0, 0, LARGURA_MUNDO, ALTURA_MUNDO);
+    uniformMatrix4fv(shaderOpaco, "projection", value_ptr(projecaoMundo));
+    uniformMatrix4fv(shaderID, "projection", value_ptr(projecaoMundo));
+    // Cor pré-multiplicada e alfa acumulado, para compor depois com (GL_ONE, GL_ONE_MINUS_SRC_ALPHA)
+    funcaoBlendSeparada(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    uniform1i(shaderOpaco, "clipID", -1);
+    uniform1i(shaderID, "clipID", -1);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+    if (cacheMapa.tudoSujo)
+    {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        desenharTiles(shaderID, nullptr);
+    }
+    else
+    {
+        habilitarGL(GL_SCISSOR_TEST, true);
+        for (const vec4 &r : recortes)
+        {
+            // Os vizinhos também encostam no retângulo do tile e são redesenhados por cima do que foi limpo
+            int x0 = (int)floor(r.x), y0 = (int)floor(r.y);
+            glScissor(x0, y0, (int)ceil(r.z) - x0, (int)ceil(r.w) - y0);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            desenharTiles(shaderID, &r);
+        }
+        habilitarGL(GL_SCISSOR_TEST, false);
+    }
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+    cacheMapa.semTranslucidos = true;
+    for (int i = 0; i < TILEMAP_HEIGHT; i++)
+    {
+        for (int j = 0; j < TILEMAP_WIDTH; j++)
+        {
+            cacheMapa.desenhado[i * TILEMAP_WIDTH + j] = map[i][j];
+            cacheMapa.semTranslucidos = cacheMapa.semTranslucidos && passoOpaco(tileset[map[i][j]].opacidade);
+        }
+    }
+    cacheMapa.tudoSujo = false;
 
-    return texID;
+    uniformMatrix4fv(shaderOpaco, "projection", value_ptr(camera.projecao));
+    uniformMatrix4fv(shaderID, "projection", value_ptr(camera.projecao));
+    usarPrograma(shaderID);
+    vincularAlvoCena();
+    funcaoBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
 void desenharMapa(GLuint shaderID)
 {
-    // dá pra fazer um cálculo usando tilemap_width e tilemap_height
-    float x0 = 575;
-    float y0 = 100;
+    PERFIL_ZONA("desenharMapa");
+    ZonaGPU zonaGPU("mapa");
 
-    for (int i = 0; i < TILEMAP_HEIGHT; i++)
+    if (depuracao.modo != DEPURACAO_DESLIGADA)
     {
-        for (int j = 0; j < TILEMAP_WIDTH; j++)
-        {
-            // Matriz de transformaçao do objeto - Matriz de modelo
-            mat4 model = mat4(1); // matriz identidade
+        desenharTiles(shaderID, nullptr);
+        return;
+    }
+    atualizarCacheMapa(shaderID);
+
+    // Um quad do tamanho do mundo com a textura do cache; a escala negativa em y desfaz a inversão de t
+    // que o vertex shader faz para as imagens carregadas do disco. O chão inteiro fica atrás de tudo
+    float z = profundidadeIso(CAMADA_CHAO, (float)(TILEMAP_HEIGHT + TILEMAP_WIDTH));
+    mat4 model = translate(mat4(1), vec3(LARGURA_MUNDO / 2.0f, ALTURA_MUNDO / 2.0f, z));
+    model = scale(model, vec3((float)LARGURA_MUNDO, -(float)ALTURA_MUNDO, 1.0f));
+    uniformMatrix4fv(shaderID, "model", value_ptr(model));
+    uniform2f(shaderID, "offsetTex", 0.0f, 0.0f);
+
+    // Sem translúcidos o alfa do cache é 0 (vazio, descartado pelo recorte) ou 1, e o quad dispensa o
+    // blending; com algum translúcido, compõe a cor pré-multiplicada
+    if (cacheMapa.semTranslucidos)
+        habilitarGL(GL_BLEND, false);
+    else
+        funcaoBlend(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    vincularVAO(cacheMapa.vaoQuad);
+    vincularTextura(0, GL_TEXTURE_2D, cacheMapa.textura);
+    desenharArrays(shaderID, GL_TRIANGLE_STRIP, 4);
+    habilitarGL(GL_BLEND, true);
+    funcaoBlend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void desenharPrincipal(GLuint shaderID)
+{
+    PERFIL_ZONA("desenharPrincipal");
+    ZonaGPU zonaGPU("principal");
 
-            Tile curr_tile = tileset[map[i][j]];
+    // Matriz de transformaçao do objeto - Matriz de modelo
+    mat4 model = mat4(1); // matriz identidade
 
-            float x = x0 + (j - i) * curr_tile.dimensions.x / 2.0;
-            float y = y0 + (j + i) * curr_tile.dimensions.y / 2.0;
+    if (principal.isAnimated) {
+        // A direção (iAnimation) escolhe o clip; o clip continua do mesmo ponto, como antes
+        principal.clipID = clipsDirecao[glm::clamp(principal.iAnimation, 0, principal.nAnimations)];
+        uniform1i(shaderID, "clipID", principal.clipID);
+        uniform1f(shaderID, "tempoInicio", principal.tempoInicio);
+    }
+
+    float tile_iso_width = tileset[0].dimensions.x;
+    float tile_iso_height = tileset[0].dimensions.y;
 
-            model = translate(model, vec3(x, y, 0.0));
-            model = scale(model, curr_tile.dimensions);
-            glUniformMatrix4fv(glGetUniformLocation(shaderID, "model"), 1, GL_FALSE, value_ptr(model));
+    float x0 = 615;
+    float y0 = 100;
 
-            vec2 offsetTex;
+    float x = x0 + (selectedTileMapColumn - selectedTileMapLine) * (tile_iso_width / 2.0f);
+    float y = (y0 + (selectedTileMapLine + selectedTileMapColumn) * (tile_iso_height / 2.0f)) + (tile_iso_height / 2.0f) - (principal.dimensions.y / 2.0f);
 
-            offsetTex.s = curr_tile.iTile * curr_tile.ds;
-            offsetTex.t = 0.0;
-            glUniform2f(glGetUniformLocation(shaderID, "offsetTex"), offsetTex.s, offsetTex.t);
+    vec3 position = vec3(x, y, profundidadeIso(CAMADA_OBJETOS, (float)(selectedTileMapLine + selectedTileMapColumn)));
+    if (!camera.visivel(position, principal.dimensions))
+        return;
 
-            glBindVertexArray(curr_tile.VAO);              // Conectando ao buffer de geometria
-            glBindTexture(GL_TEXTURE_2D, curr_tile.texID); // Conectando ao buffer de textura
+    model = translate(model, position);
+    model = rotate(model, radians(0.0f), vec3(0.0, 0.0, 1.0));
+    model = scale(model, principal.dimensions);
+    uniformMatrix4fv(shaderID, "model", value_ptr(model));
 
-            // Chamada de desenho - drawcall
-            // Poligono Preenchido - GL_TRIANGLES
-            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-        }
+    vincularTextura(0, GL_TEXTURE_2D, texturaGL(principal.textura)); // Conectando ao buffer de textura
+
+    // Chamada de desenho - drawcall: contorno justo do frame atual
+    desenharGeometriaSprite(shaderID, principal, principal.isAnimated);
+}
+
+void desenharMoeda(GLuint shaderID)
+{
+    PERFIL_ZONA("desenharMoeda");
+
+    if (coin.isCollect)
+        return;
+    ZonaGPU zonaGPU("moeda");
+
+    uniform1i(shaderID, "clipID", coin.clipID);
+    uniform1f(shaderID, "tempoInicio", coin.tempoInicio);
+
+    // Matriz de transformaçao do objeto - Matriz de modelo
+    mat4 model = mat4(1); // matriz identidade
+
+    float tile_iso_width = tileset[0].dimensions.x;
+    float tile_iso_height = tileset[0].dimensions.y;
+
+    float x0Coin = 615;
+    float y0Coin = 80;
+
+    float xCoin = x0Coin + (COIN_COLUMN - COIN_LINE) * (tile_iso_width / 2.0f);
+    float yCoin = (y0Coin + (COIN_LINE + COIN_COLUMN) * (tile_iso_height / 2.0f)) + (tile_iso_height / 2.0f) - (coin.dimensions.y / 2.0f);
+
+    vec3 positionCoin = vec3(xCoin, yCoin, profundidadeIso(CAMADA_OBJETOS, (float)(COIN_LINE + COIN_COLUMN)));
+    if (!camera.visivel(positionCoin, coin.dimensions))
+        return;
+
+    model = translate(model, positionCoin);
+    model = rotate(model, radians(0.0f), vec3(0.0, 0.0, 1.0));
+    model = scale(model, coin.dimensions);
+    uniformMatrix4fv(shaderID, "model", value_ptr(model));
+
+    vincularTextura(0, GL_TEXTURE_2D, texturaGL(coin.textura)); // Conectando ao buffer de textura
+
+    // Chamada de desenho - drawcall: contorno justo do frame atual
+    desenharGeometriaSprite(shaderID, coin, true);
+}
+
+// Sprites do mundo nos mesmos dois passos dos tiles: opacos da frente para trás (antes do mapa, que então é
+// rejeitado pelo teste de profundidade onde eles o cobrem) ou translúcidos de trás para frente (depois dele)
+void desenharObjetos(GLuint shaderID, bool opacos)
+{
+    struct ObjetoCena
+    {
+        Sprite *sprite;
+        int diagonal;
+        void (*desenhar)(GLuint);
+    };
+    ObjetoCena objetos[] = {{&principal, selectedTileMapLine + selectedTileMapColumn, desenharPrincipal},
+                            {&coin, COIN_LINE + COIN_COLUMN, desenharMoeda}};
+    std::stable_sort(std::begin(objetos), std::end(objetos), [opacos](const ObjetoCena &a, const ObjetoCena &b) {
+        return opacos ? a.diagonal < b.diagonal : a.diagonal > b.diagonal;
+    });
+
+    habilitarGL(GL_BLEND, !opacos);
+    mascaraDepth(opacos);
+    for (ObjetoCena &objeto : objetos)
+    {
+        int opacidade = opacidadeSprite(*objeto.sprite);
+        if (passoOpaco(opacidade) != opacos)
+            continue;
+        GLuint programa = programaParaOpacidade(shaderID, opacidade);
+        usarPrograma(programa);
+        objeto.desenhar(programa);
     }
+    usarPrograma(shaderID);
+    habilitarGL(GL_BLEND, true);
+    mascaraDepth(true);
 }
 
-bool isTileInArray(int tileId, const vector<int> tileVector)
+bool isTileInArray(int tileId, const vector<int> &tileVector)
 {
     for (int tile : tileVector)
     {
@@ -841,6 +6017,7 @@ bool isTileInArray(int tileId, const vector<int> tileVector)
 void finalizarJogo()
 {
     std::cout << "Você chegou ao final do jogo!" << std::endl;
+    liberarTexturasCena();
     glfwTerminate();
     exit(0);
 }
\ No newline at end of file